@@ -0,0 +1,398 @@
+//
+// Micro-benchmarks of the wrapper's own overhead, against the stub ODPI backend of dpi_stub.cpp. Usage:
+//
+//   ./bin/bench [rows]
+//
+// Each line reports the time per operation; an operation is a row, a cell, or a bind, as named.
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include <ylib/core/lang.h>
+#include <ylib/db/dpiw.h>
+#include <ylib/db/dpiw/export.h>
+#include <ylib/db/dpiw/warmup.h>
+
+#include "arrow_golden.h"
+#include "dpi_stub.h"
+
+using namespace ylib::db::dpiw;
+
+namespace {
+
+    // Defeats dead code elimination of the values read in the loops.
+    volatile UInt64 _sink;
+
+    template<typename F>
+    void bench(const char *name, UInt64 ops, F f) {
+        f(); // warm up: caches, statement cache, allocator
+
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+
+        double nanos = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        printf("%-44s %10.2f ns/op %14.0f ops/s\n", name, nanos / ops, ops * 1e9 / nanos);
+    }
+
+    const char *QUERY = "SELECT id, name, amount, created, note FROM bench";
+    const char *INSERT = "INSERT INTO bench (id, name, amount, created) VALUES (:1, :2, :3, :4)";
+
+    struct BenchRow {
+        Int64 id;
+        string name;
+        double amount;
+        optional<string> note;
+    };
+}
+
+DPIW_RECORD(BenchRow, mapField("ID", &BenchRow::id),
+            mapField("NAME", &BenchRow::name),
+            mapField("AMOUNT", &BenchRow::amount),
+            mapField("NOTE", &BenchRow::note));
+
+int main(int argc, char *argv[]) {
+    UInt64 rows = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    stub::setQueryRows(rows);
+
+    DBEnvironment env;
+    DBConnection conn = env.connect("bench", "bench", "stub");
+
+    printf("rows: %lu\n\n", (unsigned long) rows);
+
+    // Fetch
+    // =========================================================================
+    bench("ResultSet::next (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        while (rs.next() == True) {
+        }
+    });
+
+    bench("ResultSet::getInt64 (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getInt64(1);
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getString (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getString(2).size();
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getStringView (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getStringView(2).size();
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getStringOpt, NULL half (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getStringOpt(5).has_value() ? 1 : 0;
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getDateTime (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getDateTime(4).date().day();
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getInt64, DOUBLE column (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getInt64(3);
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getInt64, defined as INT64 (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        rs.defineColumn(3, DPI_NATIVE_TYPE_INT64);
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getInt64(3);
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getInt64 by name (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getInt64("ID");
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::getInt64 by lower case name (cell)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        while (rs.next() == True) {
+            sum += rs.getInt64("id");
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::forEach, 3 getters (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        UInt64 sum = 0;
+        stm.execQuery().forEach([&sum](ResultSet &r) {
+            sum += r.getInt64(1) + r.getStringView(2).size() + r.getInt64(3);
+        });
+        _sink = sum;
+    });
+
+    bench("ResultSet range-for, 3 getters (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        UInt64 sum = 0;
+        for (ResultSet &r: stm.execQuery()) {
+            sum += r.getInt64(1) + r.getStringView(2).size() + r.getInt64(3);
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::nextBatch, 3 getters (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        stm.setFetchArraySize(1000);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        rs.forEachBatch(1000, [&sum](RowBatch &b) {
+            for (UInt32 row = 1; row <= b.rowCount(); row++) {
+                sum += b.getInt64(row, 1) + b.getStringView(row, 2).size() + (UInt64) b.getDouble(row, 3);
+            }
+        });
+        _sink = sum;
+    });
+
+    bench("ResultSet::rows<5 columns> (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        stm.setFetchArraySize(1000);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        typedef std::tuple<Int64, string, double, DateTime, optional<string>> Row;
+        rs.rows<Int64, string, double, DateTime, optional<string>>().forEach([&sum](Row &row) {
+            sum += std::get<0>(row) + std::get<1>(row).size() + (UInt64) std::get<2>(row);
+        });
+        _sink = sum;
+    });
+
+    bench("ResultSet::records<4 fields> (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        stm.setFetchArraySize(1000);
+        ResultSet rs = stm.execQuery();
+        UInt64 sum = 0;
+        rs.records<BenchRow>().forEach([&sum](BenchRow &row) {
+            sum += row.id + row.name.size() + (UInt64) row.amount;
+        });
+        _sink = sum;
+    });
+
+    bench("ResultSet::materialize + 3 getters (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        stm.setFetchArraySize(1000);
+        ResultSet rs = stm.execQuery();
+        RowBlock block = rs.materialize();
+        UInt64 sum = 0;
+        const Int64 *ids = block.int64Column(1);
+        for (UInt32 row = 1; row <= block.rowCount(); row++) {
+            sum += ids[row - 1] + block.getStringView(row, 2).size() + (UInt64) block.getDouble(row, 3);
+        }
+        _sink = sum;
+    });
+
+    bench("ResultSet::materialize, column arrays (row)", rows, [&]() {
+        DBStatement stm = conn.statement(QUERY);
+        stm.setFetchArraySize(1000);
+        ResultSet rs = stm.execQuery();
+        RowBlock block = rs.materialize();
+        UInt64 sum = 0;
+        const Int64 *ids = block.int64Column(1);
+        const UInt64 *offsets = block.bytesOffsets(2);
+        const double *amounts = block.doubleColumn(3);
+        for (UInt32 row = 1; row <= block.rowCount(); row++) {
+            sum += ids[row - 1] + (offsets[row] - offsets[row - 1]) + (UInt64) amounts[row - 1];
+        }
+        _sink = sum;
+    });
+    // =========================================================================
+
+    {
+        DBMetrics metrics;
+        conn.setMetrics(&metrics);
+
+        bench("ResultSet::forEach, 3 getters, metrics on (row)", rows, [&]() {
+            DBStatement stm = conn.statement(QUERY);
+            UInt64 sum = 0;
+            stm.execQuery().forEach([&sum](ResultSet &r) {
+                sum += r.getInt64(1) + r.getStringView(2).size() + r.getInt64(3);
+            });
+            _sink = sum;
+        });
+
+        conn.setMetrics(nullptr);
+    }
+    // =========================================================================
+
+    // Bind
+    // =========================================================================
+    dpiTimestamp createdTs{2024, 1, 1, 12, 30, 15, 0, 0, 0};
+    DateTime created = timestampToDateTime(createdTs);
+    string name = "name-123";
+
+    bench("DBStatement::setInt64 (bind)", rows, [&]() {
+        DBStatement stm = conn.statement(INSERT);
+        for (UInt64 i = 0; i < rows; i++) {
+            stm.setInt64(1, (Int64) i);
+        }
+    });
+
+    bench("DBStatement::setString (bind)", rows, [&]() {
+        DBStatement stm = conn.statement(INSERT);
+        for (UInt64 i = 0; i < rows; i++) {
+            stm.setString(2, name);
+        }
+    });
+
+    bench("DBStatement::setDateTime (bind)", rows, [&]() {
+        DBStatement stm = conn.statement(INSERT);
+        for (UInt64 i = 0; i < rows; i++) {
+            stm.setDateTime(4, created);
+        }
+    });
+
+    bench("DBStatement 4 setters + exec (row)", rows, [&]() {
+        DBStatement stm = conn.statement(INSERT);
+        for (UInt64 i = 0; i < rows; i++) {
+            stm.setInt64(1, (Int64) i);
+            stm.setString(2, name);
+            stm.setDouble(3, i * 0.25);
+            stm.setDateTime(4, created);
+            stm.exec();
+        }
+    });
+
+    bench("DBVar array binds + execMany (row)", rows, [&]() {
+        const UInt32 batch = 1000;
+        DBStatement stm = conn.statement(INSERT);
+        DBVar &ids = stm.bindArrayInt64(1, batch);
+        DBVar &names = stm.bindArrayString(2, batch, 32);
+        DBVar &amounts = stm.bindArrayDouble(3, batch);
+        DBVar &dates = stm.bindArrayDateTime(4, batch);
+
+        UInt32 pending = 0;
+        for (UInt64 i = 0; i < rows; i++) {
+            pending++;
+            ids.setInt64(pending, (Int64) i);
+            names.setString(pending, name);
+            amounts.setDouble(pending, i * 0.25);
+            dates.setDateTime(pending, created);
+            if (pending == batch) {
+                stm.execMany(pending);
+                pending = 0;
+            }
+        }
+        if (pending > 0) {
+            stm.execMany(pending);
+        }
+    });
+    // =========================================================================
+
+    // Pool
+    // =========================================================================
+    {
+        DBPoolConfig config;
+        config.maxSessions = 8;
+        DBPool pool = env.pool("bench", "bench", "stub", config);
+
+        // More sessions than the pool allows must fail up front, instead of waiting forever for one.
+        WarmUpOptions options;
+        options.connections = config.maxSessions + 1;
+        try {
+            warmUp(pool, options);
+            printf("warmUp over maxSessions did not throw\n");
+            return EXIT_FAILURE;
+        } catch (DBException &ex) {
+        }
+
+        options.connections = config.maxSessions;
+        options.statements = {QUERY, INSERT};
+        bench("warmUp, 2 statements (session)", options.connections, [&]() {
+            warmUp(pool, options);
+        });
+    }
+    // =========================================================================
+
+    // Export
+    // =========================================================================
+    {
+        // The encoder is hand-written, so its output must stay the stream a real Arrow reader accepted.
+        stub::setQueryRows(3);
+        DBStatement stm = conn.statement(QUERY);
+        std::ostringstream out;
+        ExportOptions options;
+        options.batchRows = 2;
+        exportArrowIpc(stm, out, options);
+        stub::setQueryRows(rows);
+
+        string expected{(const char *) golden::ARROW_IPC_3_ROWS, sizeof(golden::ARROW_IPC_3_ROWS)};
+        if (out.str() != expected) {
+            printf("exportArrowIpc output differs from arrow_golden.h\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // =========================================================================
+
+    // Conversions
+    // =========================================================================
+    dpiTimestamp ts{2024, 2, 29, 13, 45, 30, 123000000, 0, 0};
+
+    bench("timestampToDateTime (conversion)", rows, [&]() {
+        UInt64 sum = 0;
+        for (UInt64 i = 0; i < rows; i++) {
+            ts.second = (uint8_t) (i % 60);
+            sum += timestampToDateTime(ts).time().sec();
+        }
+        _sink = sum;
+    });
+
+    bench("timestampToDate (conversion)", rows, [&]() {
+        UInt64 sum = 0;
+        for (UInt64 i = 0; i < rows; i++) {
+            ts.day = (uint8_t) (1 + i % 28);
+            sum += timestampToDate(ts).day();
+        }
+        _sink = sum;
+    });
+    // =========================================================================
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,729 @@
+//
+// In-process stub of the ODPI functions used by dpiw.h, see dpi_stub.h.
+//
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dpi.h>
+
+#include "dpi_stub.h"
+
+namespace {
+
+    const uint32_t COLUMN_COUNT = 5;
+    const uint32_t NAME_COUNT = 1024;
+    const uint32_t TEXT_SIZE = 32;
+
+    uint64_t _queryRows = 1000000;
+    int64_t _sequence = 0; //of the values returned by RETURNING INTO
+
+    thread_local dpiErrorInfo _lastError;
+
+    struct Names {
+        char text[NAME_COUNT][TEXT_SIZE];
+        uint32_t length[NAME_COUNT];
+
+        Names() {
+            for (uint32_t i = 0; i < NAME_COUNT; i++) {
+                std::string name = "name-" + std::to_string(i);
+                memcpy(text[i], name.data(), name.size());
+                length[i] = (uint32_t) name.size();
+            }
+        }
+    };
+
+    const Names _names;
+
+    int fail(const char *fnName, const char *message) {
+        memset(&_lastError, 0, sizeof(_lastError));
+        _lastError.code = 20000;
+        _lastError.message = message;
+        _lastError.messageLength = (uint32_t) strlen(message);
+        _lastError.encoding = "UTF-8";
+        _lastError.fnName = fnName;
+        _lastError.action = "stub";
+        return DPI_FAILURE;
+    }
+
+    struct Column {
+        const char *name;
+        dpiOracleTypeNum oracleTypeNum;
+        dpiNativeTypeNum nativeTypeNum;
+        uint32_t size;
+        int nullOk;
+    };
+
+    const Column _columns[COLUMN_COUNT] = {
+            {"ID",      DPI_ORACLE_TYPE_NUMBER,        DPI_NATIVE_TYPE_INT64,     8,  0},
+            {"NAME",    DPI_ORACLE_TYPE_VARCHAR,       DPI_NATIVE_TYPE_BYTES,     32, 0},
+            {"AMOUNT",  DPI_ORACLE_TYPE_NATIVE_DOUBLE, DPI_NATIVE_TYPE_DOUBLE,    8,  0},
+            {"CREATED", DPI_ORACLE_TYPE_TIMESTAMP,     DPI_NATIVE_TYPE_TIMESTAMP, 11, 0},
+            {"NOTE",    DPI_ORACLE_TYPE_VARCHAR,       DPI_NATIVE_TYPE_BYTES,     16, 1},
+    };
+
+    // Writes the value of column col (0-based) of row (1-based) into data, as nativeTypeNum. Text goes to buffer.
+    void fill(uint32_t col, uint64_t row, dpiNativeTypeNum nativeTypeNum, dpiData *data, char *buffer) {
+        data->isNull = 0;
+        switch (col) {
+            case 0:
+            case 2: {
+                double val = col == 0 ? (double) row : (double) row * 0.25;
+                if (nativeTypeNum == DPI_NATIVE_TYPE_INT64) {
+                    data->value.asInt64 = (int64_t) val;
+                } else if (nativeTypeNum == DPI_NATIVE_TYPE_UINT64) {
+                    data->value.asUint64 = (uint64_t) val;
+                } else if (nativeTypeNum == DPI_NATIVE_TYPE_FLOAT) {
+                    data->value.asFloat = (float) val;
+                } else {
+                    data->value.asDouble = val;
+                }
+                return;
+            }
+            case 1: {
+                uint32_t index = (uint32_t) (row % NAME_COUNT);
+                memcpy(buffer, _names.text[index], _names.length[index]);
+                data->value.asBytes.ptr = buffer;
+                data->value.asBytes.length = _names.length[index];
+                data->value.asBytes.encoding = "UTF-8";
+                return;
+            }
+            case 3: {
+                uint32_t seconds = (uint32_t) (row % 86400);
+                dpiTimestamp &ts = data->value.asTimestamp;
+                ts.year = 2024;
+                ts.month = 1;
+                ts.day = 1;
+                ts.hour = (uint8_t) (seconds / 3600);
+                ts.minute = (uint8_t) (seconds / 60 % 60);
+                ts.second = (uint8_t) (seconds % 60);
+                ts.fsecond = 0;
+                ts.tzHourOffset = 0;
+                ts.tzMinuteOffset = 0;
+                return;
+            }
+            default:
+                if (row % 2 == 0) {
+                    data->isNull = 1;
+                    return;
+                }
+                memcpy(buffer, "note", 4);
+                data->value.asBytes.ptr = buffer;
+                data->value.asBytes.length = 4;
+                data->value.asBytes.encoding = "UTF-8";
+                return;
+        }
+    }
+}
+
+struct dpiContext {
+    int unused;
+};
+
+struct dpiConn {
+    uint32_t stmtCacheSize;
+    dpiPool *pool; //acquired from, null for a standalone connection
+};
+
+// Sessions are acquired from many threads, see warmUp.
+struct dpiPool {
+    std::mutex mutex;
+    uint32_t busy;
+    uint32_t open;
+    uint32_t maxSessions;
+    uint32_t waitTimeout;
+};
+
+struct dpiVar {
+    dpiNativeTypeNum nativeTypeNum;
+    uint32_t maxRows;
+    uint32_t size;
+    std::vector<dpiData> data;
+    std::vector<char> buffer;
+    std::vector<dpiData> returned; //one value per row of the last execution, when it was a RETURNING INTO
+};
+
+struct dpiLob {
+    dpiOracleTypeNum type;
+    std::string content;
+    int refs;
+};
+
+struct dpiRowid {
+    int unused;
+};
+
+struct dpiStmt {
+    int refs;
+    bool query;
+    bool returning;
+    uint32_t implicitResults; //left to return, for PL/SQL calling DBMS_SQL.RETURN_RESULT
+    std::vector<dpiVar *> binds;
+    uint64_t row;
+    uint32_t fetchArraySize;
+    uint64_t rowCount;
+    dpiVar *defines[COLUMN_COUNT];
+    dpiNativeTypeNum defineTypes[COLUMN_COUNT];
+    dpiData values[COLUMN_COUNT];
+    char text[COLUMN_COUNT][TEXT_SIZE];
+    dpiRowid rowid;
+};
+
+static dpiStmt *newStmt(bool query) {
+    dpiStmt *ans = new dpiStmt{};
+    ans->refs = 1;
+    ans->query = query;
+    ans->fetchArraySize = DPI_DEFAULT_FETCH_ARRAY_SIZE;
+    return ans;
+}
+
+namespace stub {
+
+    void setQueryRows(uint64_t rows) {
+        _queryRows = rows;
+    }
+
+    uint64_t queryRows() {
+        return _queryRows;
+    }
+}
+
+extern "C" {
+
+// Context
+// =========================================================================
+int dpiContext_createWithParams(unsigned int, unsigned int, dpiContextCreateParams *, dpiContext **context,
+                                dpiErrorInfo *) {
+    *context = new dpiContext{};
+    return DPI_SUCCESS;
+}
+
+int dpiContext_destroy(dpiContext *context) {
+    delete context;
+    return DPI_SUCCESS;
+}
+
+void dpiContext_getError(const dpiContext *, dpiErrorInfo *info) {
+    *info = _lastError;
+}
+
+int dpiContext_initCommonCreateParams(const dpiContext *, dpiCommonCreateParams *params) {
+    memset(params, 0, sizeof(*params));
+    params->encoding = "UTF-8";
+    params->nencoding = "UTF-8";
+    return DPI_SUCCESS;
+}
+
+int dpiContext_initPoolCreateParams(const dpiContext *, dpiPoolCreateParams *params) {
+    memset(params, 0, sizeof(*params));
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// Connection
+// =========================================================================
+int dpiConn_create(const dpiContext *, const char *, uint32_t, const char *, uint32_t, const char *, uint32_t,
+                   const dpiCommonCreateParams *, dpiConnCreateParams *, dpiConn **conn) {
+    *conn = new dpiConn{DPI_DEFAULT_STMT_CACHE_SIZE, nullptr};
+    return DPI_SUCCESS;
+}
+
+int dpiConn_release(dpiConn *conn) {
+    if (conn->pool) {
+        std::lock_guard<std::mutex> lock{conn->pool->mutex};
+        conn->pool->busy--;
+    }
+    delete conn;
+    return DPI_SUCCESS;
+}
+
+int dpiConn_commit(dpiConn *) {
+    return DPI_SUCCESS;
+}
+
+int dpiConn_rollback(dpiConn *) {
+    return DPI_SUCCESS;
+}
+
+int dpiConn_setStmtCacheSize(dpiConn *conn, uint32_t size) {
+    conn->stmtCacheSize = size;
+    return DPI_SUCCESS;
+}
+
+int dpiConn_prepareStmt(dpiConn *, int, const char *sql, uint32_t sqlLength, const char *, uint32_t,
+                        dpiStmt **stmt) {
+    std::string head;
+    for (uint32_t i = 0; i < sqlLength && head.size() < 6; i++) {
+        if (isspace((unsigned char) sql[i]) == 0 || head.empty() == false) {
+            head.push_back((char) toupper((unsigned char) sql[i]));
+        }
+    }
+
+    std::string text{sql, sqlLength};
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char) toupper(c); });
+
+    dpiStmt *ans = newStmt(head.rfind("SELECT", 0) == 0 || head.rfind("WITH", 0) == 0);
+    ans->returning = ans->query == false && text.find(" RETURNING ") != std::string::npos;
+    ans->implicitResults = text.find("RETURN_RESULT") != std::string::npos ? 2 : 0;
+    *stmt = ans;
+    return DPI_SUCCESS;
+}
+
+int dpiConn_newVar(dpiConn *, dpiOracleTypeNum, dpiNativeTypeNum nativeTypeNum, uint32_t maxArraySize,
+                   uint32_t size, int, int, dpiObjectType *, dpiVar **var, dpiData **data) {
+    dpiVar *ans = new dpiVar{};
+    ans->nativeTypeNum = nativeTypeNum;
+    ans->maxRows = maxArraySize;
+    ans->size = std::max<uint32_t>(size, TEXT_SIZE);
+    ans->data.resize(maxArraySize);
+    if (nativeTypeNum == DPI_NATIVE_TYPE_STMT) {
+        for (uint32_t i = 0; i < maxArraySize; i++) {
+            ans->data[i].value.asStmt = newStmt(true); //an opened REF cursor, as if the block ran
+        }
+    }
+    if (nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+        ans->buffer.resize((size_t) maxArraySize * ans->size);
+        for (uint32_t i = 0; i < maxArraySize; i++) {
+            ans->data[i].value.asBytes.ptr = &ans->buffer[(size_t) i * ans->size];
+            ans->data[i].value.asBytes.length = 0;
+        }
+    }
+
+    *var = ans;
+    *data = ans->data.data();
+    return DPI_SUCCESS;
+}
+
+int dpiConn_newTempLob(dpiConn *, dpiOracleTypeNum lobType, dpiLob **lob) {
+    *lob = new dpiLob{lobType, {}, 1};
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// Pool
+// =========================================================================
+int dpiPool_create(const dpiContext *, const char *, uint32_t, const char *, uint32_t, const char *, uint32_t,
+                   const dpiCommonCreateParams *, dpiPoolCreateParams *params, dpiPool **pool) {
+    *pool = new dpiPool;
+    (*pool)->busy = 0;
+    (*pool)->open = params->minSessions;
+    (*pool)->maxSessions = params->maxSessions;
+    (*pool)->waitTimeout = params->waitTimeout;
+    return DPI_SUCCESS;
+}
+
+int dpiPool_acquireConnection(dpiPool *pool, const char *, uint32_t, const char *, uint32_t, dpiConnCreateParams *,
+                              dpiConn **conn) {
+    std::lock_guard<std::mutex> lock{pool->mutex};
+    if (pool->busy == pool->maxSessions) {
+        // The real pool would wait for a session to be released, which can't happen here.
+        return fail("dpiPool_acquireConnection", "ORA-24418: Cannot open further sessions.");
+    }
+    pool->busy++;
+    pool->open = std::max(pool->open, pool->busy);
+    *conn = new dpiConn{DPI_DEFAULT_STMT_CACHE_SIZE, pool};
+    return DPI_SUCCESS;
+}
+
+int dpiPool_getBusyCount(dpiPool *pool, uint32_t *value) {
+    std::lock_guard<std::mutex> lock{pool->mutex};
+    *value = pool->busy;
+    return DPI_SUCCESS;
+}
+
+int dpiPool_getOpenCount(dpiPool *pool, uint32_t *value) {
+    std::lock_guard<std::mutex> lock{pool->mutex};
+    *value = pool->open;
+    return DPI_SUCCESS;
+}
+
+int dpiPool_setWaitTimeout(dpiPool *pool, uint32_t value) {
+    pool->waitTimeout = value;
+    return DPI_SUCCESS;
+}
+
+int dpiPool_close(dpiPool *, dpiPoolCloseMode) {
+    return DPI_SUCCESS;
+}
+
+int dpiPool_release(dpiPool *pool) {
+    delete pool;
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// Statement
+// =========================================================================
+int dpiStmt_addRef(dpiStmt *stmt) {
+    stmt->refs++;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_release(dpiStmt *stmt) {
+    if (--stmt->refs == 0) {
+        delete stmt;
+    }
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getNumQueryColumns(dpiStmt *stmt, uint32_t *numQueryColumns) {
+    *numQueryColumns = stmt->query ? COLUMN_COUNT : 0;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getImplicitResult(dpiStmt *stmt, dpiStmt **implicitResult) {
+    *implicitResult = nullptr;
+    if (stmt->implicitResults > 0) {
+        stmt->implicitResults--;
+        *implicitResult = newStmt(true);
+    }
+    return DPI_SUCCESS;
+}
+
+// A RETURNING INTO gives back, for each row, the next value of a sequence in every variable bound. Only numeric
+// variables are supported.
+static void returnValues(dpiStmt *stmt, uint32_t numIters) {
+    if (stmt->returning == false) {
+        return;
+    }
+
+    for (dpiVar *var: stmt->binds) {
+        var->returned.assign(numIters, dpiData{});
+    }
+    for (uint32_t i = 0; i < numIters; i++) {
+        _sequence++;
+        for (dpiVar *var: stmt->binds) {
+            if (var->nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
+                var->returned[i].value.asDouble = (double) _sequence;
+            } else {
+                var->returned[i].value.asInt64 = _sequence;
+            }
+        }
+    }
+}
+
+int dpiStmt_execute(dpiStmt *stmt, dpiExecMode, uint32_t *numQueryColumns) {
+    stmt->row = 0;
+    stmt->rowCount = stmt->query ? 0 : 1;
+    returnValues(stmt, stmt->query ? 0 : 1);
+    if (numQueryColumns) {
+        *numQueryColumns = stmt->query ? COLUMN_COUNT : 0;
+    }
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_executeMany(dpiStmt *stmt, dpiExecMode, uint32_t numIters) {
+    if (stmt->query) {
+        return fail("dpiStmt_executeMany", "DPI-1013: not supported");
+    }
+    stmt->rowCount = numIters;
+    returnValues(stmt, numIters);
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_fetch(dpiStmt *stmt, int *found, uint32_t *bufferRowIndex) {
+    if (stmt->row >= _queryRows) {
+        *found = 0;
+        *bufferRowIndex = 0;
+        return DPI_SUCCESS;
+    }
+
+    // Same as the driver, the rows come in blocks of fetch array size.
+    *bufferRowIndex = (uint32_t) (stmt->row % stmt->fetchArraySize);
+    stmt->row++;
+    *found = 1;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_fetchRows(dpiStmt *stmt, uint32_t maxRows, uint32_t *bufferRowIndex, uint32_t *numRowsFetched,
+                      int *moreRows) {
+    uint64_t remaining = _queryRows - std::min(stmt->row, _queryRows);
+    uint32_t count = (uint32_t) std::min<uint64_t>(std::min(maxRows, stmt->fetchArraySize), remaining);
+
+    for (uint32_t col = 0; col < COLUMN_COUNT; col++) {
+        dpiVar *var = stmt->defines[col];
+        if (var == nullptr) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            char *buffer = var->buffer.empty() ? nullptr : &var->buffer[(size_t) i * var->size];
+            fill(col, stmt->row + i + 1, var->nativeTypeNum, &var->data[i], buffer);
+        }
+    }
+
+    stmt->row += count;
+    *bufferRowIndex = 0;
+    *numRowsFetched = count;
+    *moreRows = stmt->row < _queryRows ? 1 : 0;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getQueryValue(dpiStmt *stmt, uint32_t pos, dpiNativeTypeNum *nativeTypeNum, dpiData **data) {
+    if (pos < 1 || pos > COLUMN_COUNT) {
+        return fail("dpiStmt_getQueryValue", "DPI-1028: query position is invalid");
+    }
+
+    uint32_t col = pos - 1;
+    dpiNativeTypeNum type = stmt->defineTypes[col] ? stmt->defineTypes[col] : _columns[col].nativeTypeNum;
+    fill(col, stmt->row, type, &stmt->values[col], stmt->text[col]);
+    *nativeTypeNum = type;
+    *data = &stmt->values[col];
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getQueryInfo(dpiStmt *, uint32_t pos, dpiQueryInfo *info) {
+    if (pos < 1 || pos > COLUMN_COUNT) {
+        return fail("dpiStmt_getQueryInfo", "DPI-1028: query position is invalid");
+    }
+
+    const Column &column = _columns[pos - 1];
+    memset(info, 0, sizeof(*info));
+    info->name = column.name;
+    info->nameLength = (uint32_t) strlen(column.name);
+    info->typeInfo.oracleTypeNum = column.oracleTypeNum;
+    info->typeInfo.defaultNativeTypeNum = column.nativeTypeNum;
+    info->typeInfo.dbSizeInBytes = column.size;
+    info->typeInfo.clientSizeInBytes = column.size;
+    info->typeInfo.sizeInChars = column.size;
+    info->nullOk = column.nullOk;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_setFetchArraySize(dpiStmt *stmt, uint32_t arraySize) {
+    stmt->fetchArraySize = arraySize == 0 ? DPI_DEFAULT_FETCH_ARRAY_SIZE : arraySize;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getFetchArraySize(dpiStmt *stmt, uint32_t *arraySize) {
+    *arraySize = stmt->fetchArraySize;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_define(dpiStmt *stmt, uint32_t pos, dpiVar *var) {
+    if (pos < 1 || pos > COLUMN_COUNT) {
+        return fail("dpiStmt_define", "DPI-1028: query position is invalid");
+    }
+    stmt->defines[pos - 1] = var;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_defineValue(dpiStmt *stmt, uint32_t pos, dpiOracleTypeNum, dpiNativeTypeNum nativeTypeNum, uint32_t,
+                        int, dpiObjectType *) {
+    if (pos < 1 || pos > COLUMN_COUNT) {
+        return fail("dpiStmt_defineValue", "DPI-1028: query position is invalid");
+    }
+    stmt->defineTypes[pos - 1] = nativeTypeNum;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_bindValueByPos(dpiStmt *, uint32_t, dpiNativeTypeNum, dpiData *) {
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_bindValueByName(dpiStmt *, const char *, uint32_t, dpiNativeTypeNum, dpiData *) {
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_bindByPos(dpiStmt *stmt, uint32_t, dpiVar *var) {
+    stmt->binds.push_back(var);
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_bindByName(dpiStmt *stmt, const char *, uint32_t, dpiVar *var) {
+    stmt->binds.push_back(var);
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getRowCount(dpiStmt *stmt, uint64_t *count) {
+    *count = stmt->query ? stmt->row : stmt->rowCount;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getRowCounts(dpiStmt *, uint32_t *numRowCounts, uint64_t **rowCounts) {
+    *numRowCounts = 0;
+    *rowCounts = nullptr;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getBatchErrorCount(dpiStmt *, uint32_t *count) {
+    *count = 0;
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getBatchErrors(dpiStmt *, uint32_t, dpiErrorInfo *) {
+    return DPI_SUCCESS;
+}
+
+int dpiStmt_getLastRowid(dpiStmt *stmt, dpiRowid **rowid) {
+    *rowid = &stmt->rowid;
+    return DPI_SUCCESS;
+}
+
+int dpiRowid_getStringValue(dpiRowid *, const char **value, uint32_t *valueLength) {
+    *value = "AAAAAAAAAAAAAAAAAA";
+    *valueLength = 18;
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// Variable
+// =========================================================================
+int dpiVar_release(dpiVar *var) {
+    if (var->nativeTypeNum == DPI_NATIVE_TYPE_STMT) {
+        for (dpiData &data: var->data) {
+            dpiStmt_release(data.value.asStmt);
+        }
+    }
+    delete var;
+    return DPI_SUCCESS;
+}
+
+int dpiVar_getReturnedData(dpiVar *var, uint32_t pos, uint32_t *numElements, dpiData **data) {
+    if (pos >= var->maxRows) {
+        return fail("dpiVar_getReturnedData", "DPI-1009: array position is invalid");
+    }
+
+    *numElements = pos < var->returned.size() ? 1 : 0;
+    *data = pos < var->returned.size() ? &var->returned[pos] : nullptr;
+    return DPI_SUCCESS;
+}
+
+int dpiVar_setFromBytes(dpiVar *var, uint32_t pos, const char *value, uint32_t valueLength) {
+    if (pos >= var->maxRows || valueLength > var->size) {
+        return fail("dpiVar_setFromBytes", "DPI-1019: buffer size too small");
+    }
+
+    dpiData &data = var->data[pos];
+    memcpy(&var->buffer[(size_t) pos * var->size], value, valueLength);
+    data.isNull = 0;
+    data.value.asBytes.length = valueLength;
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// LOB, offsets and amounts in bytes regardless of the type
+// =========================================================================
+int dpiLob_addRef(dpiLob *lob) {
+    lob->refs++;
+    return DPI_SUCCESS;
+}
+
+int dpiLob_release(dpiLob *lob) {
+    if (--lob->refs == 0) {
+        delete lob;
+    }
+    return DPI_SUCCESS;
+}
+
+int dpiLob_getType(dpiLob *lob, dpiOracleTypeNum *type) {
+    *type = lob->type;
+    return DPI_SUCCESS;
+}
+
+int dpiLob_getSize(dpiLob *lob, uint64_t *size) {
+    *size = lob->content.size();
+    return DPI_SUCCESS;
+}
+
+int dpiLob_getChunkSize(dpiLob *, uint32_t *size) {
+    *size = 8132;
+    return DPI_SUCCESS;
+}
+
+int dpiLob_getBufferSize(dpiLob *, uint64_t sizeInChars, uint64_t *sizeInBytes) {
+    *sizeInBytes = sizeInChars * 4;
+    return DPI_SUCCESS;
+}
+
+int dpiLob_readBytes(dpiLob *lob, uint64_t offset, uint64_t amount, char *value, uint64_t *valueLength) {
+    uint64_t start = std::min<uint64_t>(offset - 1, lob->content.size());
+    uint64_t count = std::min<uint64_t>({amount, *valueLength, lob->content.size() - start});
+    memcpy(value, lob->content.data() + start, count);
+    *valueLength = count;
+    return DPI_SUCCESS;
+}
+
+int dpiLob_writeBytes(dpiLob *lob, uint64_t offset, const char *value, uint64_t valueLength) {
+    uint64_t start = offset - 1;
+    if (lob->content.size() < start + valueLength) {
+        lob->content.resize(start + valueLength);
+    }
+    memcpy(&lob->content[start], value, valueLength);
+    return DPI_SUCCESS;
+}
+
+int dpiLob_trim(dpiLob *lob, uint64_t newSize) {
+    lob->content.resize(std::min<uint64_t>(newSize, lob->content.size()));
+    return DPI_SUCCESS;
+}
+
+int dpiLob_openResource(dpiLob *) {
+    return DPI_SUCCESS;
+}
+
+int dpiLob_closeResource(dpiLob *) {
+    return DPI_SUCCESS;
+}
+// =========================================================================
+
+// Data, same as ODPI's own dpiData.c
+// =========================================================================
+int dpiData_getIsNull(dpiData *data) {
+    return data->isNull;
+}
+
+void dpiData_setNull(dpiData *data) {
+    data->isNull = 1;
+}
+
+void dpiData_setBytes(dpiData *data, char *ptr, uint32_t length) {
+    data->isNull = 0;
+    data->value.asBytes.ptr = ptr;
+    data->value.asBytes.length = length;
+}
+
+void dpiData_setInt64(dpiData *data, int64_t value) {
+    data->isNull = 0;
+    data->value.asInt64 = value;
+}
+
+void dpiData_setUint64(dpiData *data, uint64_t value) {
+    data->isNull = 0;
+    data->value.asUint64 = value;
+}
+
+void dpiData_setDouble(dpiData *data, double value) {
+    data->isNull = 0;
+    data->value.asDouble = value;
+}
+
+void dpiData_setBool(dpiData *data, int value) {
+    data->isNull = 0;
+    data->value.asBoolean = value;
+}
+
+void dpiData_setTimestamp(dpiData *data, int16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute,
+                          uint8_t second, uint32_t fsecond, int8_t tzHourOffset, int8_t tzMinuteOffset) {
+    data->isNull = 0;
+    dpiTimestamp &ts = data->value.asTimestamp;
+    ts.year = year;
+    ts.month = month;
+    ts.day = day;
+    ts.hour = hour;
+    ts.minute = minute;
+    ts.second = second;
+    ts.fsecond = fsecond;
+    ts.tzHourOffset = tzHourOffset;
+    ts.tzMinuteOffset = tzMinuteOffset;
+}
+
+void dpiData_setLOB(dpiData *data, dpiLob *lob) {
+    data->isNull = 0;
+    data->value.asLOB = lob;
+}
+// =========================================================================
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * In-process stand-in for the ODPI library, so the wrapper can be measured without a database. It implements the dpi*
+ * functions used by dpiw.h, with no I/O and as little work as possible, so the time measured is the wrapper's.
+ *
+ * Any statement starting with SELECT or WITH is a query, and returns stub::queryRows() rows of:
+ *
+ *   ID       NUMBER(18)      row number, from 1
+ *   NAME     VARCHAR2(32)    "name-<n>", cycling over 1024 values
+ *   AMOUNT   BINARY_DOUBLE   ID * 0.25
+ *   CREATED  TIMESTAMP       2024-01-01, plus ID seconds (mod one day)
+ *   NOTE     VARCHAR2(16)    NULL in even rows, "note" otherwise
+ *
+ * Everything else is DML: binds are accepted, executions affect one row per iteration and never fail. A DML with
+ * RETURNING INTO returns one value per iteration in each bound variable, from a sequence starting at 1. REF cursor
+ * variables, and the two implicit results of any statement mentioning RETURN_RESULT, are queries as above.
+ */
+namespace stub {
+
+    void setQueryRows(uint64_t rows);
+
+    uint64_t queryRows();
+}
@@ -1,12 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
 #include <cstring>
+#include <exception>
 #include <optional>
 #include <functional>
+#include <istream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <dpi.h>
 #include <ylib/core/lang.h>
 #include <ylib/logging/Logger.h>
+#include <ylib/db/dpiw/metrics.h>
+#include <ylib/db/dpiw/slowlog.h>
 
 using ylib::logging::Logger;
 using namespace ylib::core;
@@ -23,6 +40,7 @@ namespace ylib {
                 const string _funcName;
                 const string _action;
                 const string _message;
+                const Int32 _code = 0;
 
             public:
                 DBException(const string &message) : Exception(message), _message{message} {
@@ -31,10 +49,12 @@ namespace ylib {
 
                 DBException(const string &funcName,
                             const string &action,
-                            const string &message) :
+                            const string &message,
+                            Int32 code = 0) :
                         _funcName{funcName},
                         _action{action},
-                        _message{message} {
+                        _message{message},
+                        _code{code} {
 
                     //_msg is a parent protected field
                     _msg = "ODPI Error: " + _message;
@@ -60,7 +80,7 @@ namespace ylib {
                     string __ac = err->action;
                     string __tx{err->message, err->messageLength};
 
-                    DBException ex{__fn, __ac, __tx};
+                    DBException ex{__fn, __ac, __tx, err->code};
                     return ex;
                 }
 
@@ -80,265 +100,3183 @@ namespace ylib {
                 string msg() {
                     return _message;
                 }
+
+                // The Oracle error code, e.g. 1 for ORA-00001. Zero when the error didn't come from ODPI.
+                Int32 code() {
+                    return _code;
+                }
+            };
+
+            /*
+             * The error of a try* call, for the failures a caller expects and handles, e.g. ORA-00001 in an upsert loop.
+             * Unlike DBException::build, it doesn't allocate: it keeps the code and points to the message in ODPI's
+             * per thread error buffer. That buffer is overwritten by the next failing ODPI call on the same thread, so
+             * call message(), or toException(), before making another one.
+             */
+            class DBError {
+            private:
+                Int32 _code = 0;
+                UInt32 _offset = 0;
+                const char *_fnName = nullptr; //not owned, static in ODPI
+                const char *_action = nullptr; //not owned, static in ODPI
+                const char *_message = nullptr; //not owned, ODPI's thread error buffer
+                UInt32 _messageLength = 0;
+                Bool _recoverable{False};
+
+            public:
+                DBError() = default;
+
+                explicit DBError(const dpiErrorInfo &err) {
+                    _code = err.code;
+                    _offset = err.offset;
+                    _fnName = err.fnName;
+                    _action = err.action;
+                    _message = err.message;
+                    _messageLength = err.messageLength;
+                    _recoverable = err.isRecoverable ? True : False;
+                }
+
+                // The error of the last ODPI call that failed on this thread.
+                static DBError last(dpiContext *ctx) {
+                    dpiErrorInfo err;
+                    dpiContext_getError(ctx, &err);
+                    return DBError{err};
+                }
+
+                Int32 code() const {
+                    return _code;
+                }
+
+                // The row of an execMany, or the position in the SQL text, the error refers to. 0-based, as in ODPI.
+                UInt32 offset() const {
+                    return _offset;
+                }
+
+                // Whether retrying may succeed, e.g. after a session was killed.
+                Bool recoverable() const {
+                    return _recoverable;
+                }
+
+                string funcName() const {
+                    return _fnName ? _fnName : "";
+                }
+
+                string action() const {
+                    return _action ? _action : "";
+                }
+
+                string message() const {
+                    return _message ? string{_message, _messageLength} : "";
+                }
+
+                DBException toException() const {
+                    return DBException{funcName(), action(), message(), _code};
+                }
+            };
+
+            /*
+             * What a try* call returns: either its value or a DBError, expected style. T must be default
+             * constructible. DBResult<> is for calls without a value.
+             *
+             * Only the failures of the database call are returned. Misuse is still thrown as a DBException, the same
+             * as the throwing call: an invalid argument, or a parameter left unbound on a cached statement (see
+             * BoundParams).
+             */
+            template<typename T = void>
+            class DBResult {
+            private:
+                T _value{};
+                DBError _error;
+                Bool _ok{True};
+
+            public:
+                DBResult(T value) : _value{std::move(value)} {
+
+                }
+
+                DBResult(const DBError &error) : _error{error}, _ok{False} {
+
+                }
+
+                Bool ok() const {
+                    return _ok;
+                }
+
+                explicit operator bool() const {
+                    return _ok == True;
+                }
+
+                // The value, or a DBException when the call failed.
+                T &value() {
+                    if (_ok == False) {
+                        throw _error.toException();
+                    }
+                    return _value;
+                }
+
+                const DBError &error() const {
+                    return _error;
+                }
+            };
+
+            template<>
+            class DBResult<void> {
+            private:
+                DBError _error;
+                Bool _ok{True};
+
+            public:
+                DBResult() = default;
+
+                DBResult(const DBError &error) : _error{error}, _ok{False} {
+
+                }
+
+                Bool ok() const {
+                    return _ok;
+                }
+
+                explicit operator bool() const {
+                    return _ok == True;
+                }
+
+                // Throws a DBException when the call failed.
+                void value() const {
+                    if (_ok == False) {
+                        throw _error.toException();
+                    }
+                }
+
+                const DBError &error() const {
+                    return _error;
+                }
+            };
+
+            // Conversion helpers
+            // =========================================================================
+            // Shared by ResultSet (one row at a time) and RowBatch (a block of rows). The col param is only used
+            // for error messages.
+
+            inline double dataToDouble(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+                if (nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
+                    return data->value.asDouble;
+                }
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_FLOAT) {
+                    return data->value.asFloat;
+                }
+
+                throw Exception(sfput("Could not convert column index {} to double. "
+                                      "The dpiNativeTypeNum is: {}.", col, nativeTypeNum));
+            }
+
+            inline Int64 dataToInt64(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_INT64) {
+                    return data->value.asInt64;
+                }
+
+                // Exact only up to 2^53. Fetch the column as INT64 instead, see ResultSet::defineColumn.
+                if (nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
+                    return (Int64) data->value.asDouble;
+                }
+
+                throw Exception(sfput("Could not convert column index {} to Int64. "
+                                      "The dpiNativeTypeNum is: {}.", col, nativeTypeNum));
+            }
+
+            inline UInt64 dataToUInt64(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_UINT64) {
+                    return data->value.asUint64;
+                }
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
+                    return (UInt64) data->value.asDouble;
+                }
+
+                if(nativeTypeNum == DPI_NATIVE_TYPE_INT64){
+                    Int64 val = data->value.asInt64;
+                    if(val < 0){
+                        throw Exception(sfput("Could not convert column index {} to UInt64, "
+                                              "negative value: {}. The dpiNativeTypeNum is: {}.", col,
+                                              val, nativeTypeNum));
+                    }
+                    return (UInt64)val;
+                }
+
+                throw Exception(sfput("Could not convert column index {} to UInt64. "
+                                      "The dpiNativeTypeNum is: {}.", col, nativeTypeNum));
+            }
+
+            inline dpiTimestamp dataToTimestamp(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_TIMESTAMP) {
+                    return data->value.asTimestamp;
+                }
+
+                throw Exception(sfput("Could not convert column index ${} to dpiTimestamp. "
+                                      "The dpiNativeTypeNum is: ${}.", col, nativeTypeNum));
+            }
+
+            inline string dataToString(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+                if (nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+                    dpiBytes val = data->value.asBytes;
+                    UInt32 len = val.length;
+                    char *ptr = val.ptr;
+                    string ans{ptr, len};
+                    return ans;
+                }
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
+                    return std::to_string(dataToDouble(data, nativeTypeNum, col));
+                }
+
+                if (nativeTypeNum == DPI_NATIVE_TYPE_INT64) {
+                    return std::to_string(dataToInt64(data, nativeTypeNum, col));
+                }
+
+                throw Exception(sfput("Could not convert column index ${} to std::string. "
+                                      "The dpiNativeTypeNum is: ${}.", col, nativeTypeNum));
+            }
+
+            // Points into the driver's buffer, so the view is only valid while the row is. Only BYTES columns have
+            // a buffer to point to; anything else would need a conversion, use dataToString for those.
+            inline std::string_view dataToStringView(dpiData *data, dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+                if (nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+                    dpiBytes &val = data->value.asBytes;
+                    return {val.ptr, val.length};
+                }
+
+                throw Exception(sfput("Could not convert column index {} to std::string_view. "
+                                      "The dpiNativeTypeNum is: {}.", col, nativeTypeNum));
+            }
+
+            inline Int32 checkedInt32(Int64 val, unsigned int col) {
+                if (val > std::numeric_limits<Int32>::max() ||
+                    val < std::numeric_limits<Int32>::lowest()) {
+                    throw Exception(sfput("The value for colum ${}, is outside of the Int32 limits.", col));
+                }
+                return (Int32) val;
+            }
+
+            // Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's days_from_civil).
+            constexpr Int64 daysFromCivil(Int64 y, UInt32 m, UInt32 d) {
+                y -= m <= 2 ? 1 : 0;
+                const Int64 era = (y >= 0 ? y : y - 399) / 400;
+                const UInt32 yoe = (UInt32) (y - era * 400);
+                const UInt32 doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+                const UInt32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+                return era * 146097 + (Int64) doe - 719468;
+            }
+
+            struct CivilDate {
+                Int64 year;
+                UInt32 month; //[1, 12]
+                UInt32 day; //[1, 31]
+            };
+
+            // The inverse of daysFromCivil (Howard Hinnant's civil_from_days).
+            constexpr CivilDate civilFromDays(Int64 days) {
+                days += 719468;
+                const Int64 era = (days >= 0 ? days : days - 146096) / 146097;
+                const UInt32 doe = (UInt32) (days - era * 146097);
+                const UInt32 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+                const UInt32 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+                const UInt32 mp = (5 * doy + 2) / 153;
+                const UInt32 d = doy - (153 * mp + 2) / 5 + 1;
+                const UInt32 m = mp < 10 ? mp + 3 : mp - 9;
+                return {(Int64) yoe + era * 400 + (m <= 2 ? 1 : 0), m, d};
+            }
+
+            static_assert(daysFromCivil(1970, 1, 1) == 0);
+            static_assert(daysFromCivil(2000, 3, 1) == 11017);
+            static_assert(civilFromDays(11017).year == 2000 && civilFromDays(11017).month == 3);
+
+            // Seconds since the epoch, in UTC. The fields of a timestamp with time zone are local to its offset.
+            constexpr Int64 timestampToEpochSeconds(const dpiTimestamp &ts) {
+                return daysFromCivil(ts.year, ts.month, ts.day) * 86400 +
+                       ts.hour * 3600 + ts.minute * 60 + ts.second -
+                       ts.tzHourOffset * 3600 - ts.tzMinuteOffset * 60;
+            }
+
+            // Microseconds since the epoch, in UTC.
+            inline Int64 timestampToEpochMicros(const dpiTimestamp &ts) {
+                return timestampToEpochSeconds(ts) * 1'000'000 + ts.fsecond / 1000;
+            }
+
+            /*
+             * The timestamp in UTC, as a tm. Plain arithmetic instead of timegm and gmtime, so it's safe to call from
+             * any number of threads (gmtime returns a pointer to shared storage) and doesn't lock or read the time zone
+             * database.
+             */
+            inline tm toTimeGMT(const dpiTimestamp &timestamp) {
+                Int64 seconds = timestampToEpochSeconds(timestamp);
+                Int64 days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+                Int64 secondOfDay = seconds - days * 86400;
+                CivilDate date = civilFromDays(days);
+
+                tm t{};
+                t.tm_year = (int) (date.year - 1900); //tm year is since 1900
+                t.tm_mon = (int) date.month - 1; //tm month is [0, 11]
+                t.tm_mday = (int) date.day;
+                t.tm_hour = (int) (secondOfDay / 3600);
+                t.tm_min = (int) (secondOfDay / 60 % 60);
+                t.tm_sec = (int) (secondOfDay % 60);
+                t.tm_wday = (int) ((days % 7 + 11) % 7); //1970-01-01 was a Thursday
+                t.tm_yday = (int) (days - daysFromCivil(date.year, 1, 1));
+                return t;
+            }
+
+            inline Date timestampToDate(const dpiTimestamp &timestamp) {
+                return Date(toTimeGMT(timestamp));
+            }
+
+            inline DateTime timestampToDateTime(const dpiTimestamp &timestamp) {
+                tm t2 = toTimeGMT(timestamp);
+                UInt16 millis = (UInt16) (timestamp.fsecond / 1'000'000);
+
+                Date date{t2};
+                Time time{t2, millis};
+
+                return DateTime(date, time);
+            }
+            // =========================================================================
+
+            // The LONG type a LOB column is fetched as, when its value comes inline with the row instead of as a
+            // locator. Returns False for non LOB (or BFILE) columns.
+            inline Bool lobInlineType(dpiOracleTypeNum type, dpiOracleTypeNum &inlineType) {
+                if (type == DPI_ORACLE_TYPE_CLOB || type == DPI_ORACLE_TYPE_NCLOB) {
+                    inlineType = DPI_ORACLE_TYPE_LONG_VARCHAR;
+                    return True;
+                }
+
+                if (type == DPI_ORACLE_TYPE_BLOB) {
+                    inlineType = DPI_ORACLE_TYPE_LONG_RAW;
+                    return True;
+                }
+                return False;
+            }
+
+            /*
+             * Chunked access to a CLOB, NCLOB or BLOB. Reads and writes are made in multiples of the LOB chunk size, which
+             * is what the server stores and transfers most efficiently.
+             *
+             * For CLOB and NCLOB, the driver counts offsets in characters, not bytes. The writes assume UTF-8 data (the
+             * ODPI default encoding), and are only split on character boundaries.
+             *
+             * Writes are buffered, call close() before using the LOB in a statement. The destructor closes it too, but
+             * can only log a failure.
+             */
+            class LobStream {
+            private:
+                dpiContext *_ctx = nullptr; //not owned
+                dpiLob *_lob = nullptr;
+                Bool _character{False};
+                UInt32 _chunkSize = 0;
+                UInt32 _chunksPerCall = 0;
+                UInt64 _writeOffset = 1; //1-based, in characters for CLOB
+                string _pending; //buffered writes
+                Bool _opened{False};
+
+                // Number of UTF-16 code units (what Oracle counts as characters) in a UTF-8 buffer.
+                static UInt64 characterCount(const char *data, size_t len) {
+                    UInt64 count = 0;
+                    for (size_t i = 0; i < len; i++) {
+                        unsigned char c = (unsigned char) data[i];
+                        if ((c & 0xC0) != 0x80) {
+                            count += (c >= 0xF0) ? 2 : 1; //4 bytes sequences are surrogate pairs
+                        }
+                    }
+                    return count;
+                }
+
+                // Moves len back so that the buffer doesn't end in the middle of a UTF-8 sequence.
+                static size_t characterBoundary(const string &data, size_t len) {
+                    size_t end = len;
+                    while (end > 0 && ((unsigned char) data[end - 1] & 0xC0) == 0x80) {
+                        end--;
+                    }
+
+                    if (end == 0) {
+                        return len;
+                    }
+
+                    // end - 1 is the lead byte of the last sequence, check whether it's complete.
+                    unsigned char lead = (unsigned char) data[end - 1];
+                    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+                    return (len - (end - 1) >= need) ? len : end - 1;
+                }
+
+                void writePending(Bool all) {
+                    size_t callSize = (size_t) _chunkSize * _chunksPerCall;
+                    size_t len = all == True ? _pending.size() : (_pending.size() / callSize) * callSize;
+                    if (all == False && _character == True) {
+                        len = characterBoundary(_pending, len);
+                    }
+
+                    if (len == 0) {
+                        return;
+                    }
+
+                    if (_opened == False) {
+                        // Keeps the LOB indexes from being updated on every write, until closeResource.
+                        if (dpiLob_openResource(_lob) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                        _opened = True;
+                    }
+
+                    if (dpiLob_writeBytes(_lob, _writeOffset, _pending.data(), len) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    _writeOffset += _character == True ? characterCount(_pending.data(), len) : len;
+                    _pending.erase(0, len);
+                }
+
+            public:
+                /*
+                 * chunksPerCall is how many chunks are read or written per round trip. When addRef is False, the
+                 * reference held by the caller is taken over instead of adding a new one.
+                 */
+                LobStream(dpiContext *ctx, dpiLob *lob, Bool addRef = True, UInt32 chunksPerCall = 16) {
+                    checkParamIsPositive("chunksPerCall", chunksPerCall);
+
+                    _ctx = ctx;
+                    if (addRef == True && dpiLob_addRef(lob) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _lob = lob;
+                    _chunksPerCall = chunksPerCall;
+
+                    dpiOracleTypeNum type;
+                    if (dpiLob_getType(_lob, &type) == DPI_FAILURE ||
+                        dpiLob_getChunkSize(_lob, &_chunkSize) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    _character = (type == DPI_ORACLE_TYPE_CLOB || type == DPI_ORACLE_TYPE_NCLOB) ? True : False;
+                    if (_chunkSize == 0) {
+                        _chunkSize = 8192;
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                LobStream(const LobStream &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                LobStream &operator=(const LobStream &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                dpiLob *handle() {
+                    return _lob;
+                }
+
+                // In characters for CLOB and NCLOB, in bytes for BLOB.
+                UInt64 size() {
+                    uint64_t size;
+                    if (dpiLob_getSize(_lob, &size) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return size;
+                }
+
+                UInt32 chunkSize() {
+                    return _chunkSize;
+                }
+
+                // Calls sink with each block read, until the whole LOB is consumed.
+                void read(std::function<void(const char *, UInt64)> sink) {
+                    UInt64 amount = (UInt64) _chunkSize * _chunksPerCall;
+
+                    uint64_t bufferSize;
+                    if (dpiLob_getBufferSize(_lob, amount, &bufferSize) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    std::vector<char> buffer(bufferSize);
+                    UInt64 total = size();
+                    for (UInt64 offset = 1; offset <= total; offset += amount) {
+                        uint64_t len = bufferSize;
+                        if (dpiLob_readBytes(_lob, offset, amount, buffer.data(), &len) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+
+                        if (len == 0) {
+                            break;
+                        }
+                        sink(buffer.data(), len);
+                    }
+                }
+
+                void readTo(std::ostream &out) {
+                    read([&out](const char *data, UInt64 len) {
+                        out.write(data, (std::streamsize) len);
+                    });
+                }
+
+                string readAll() {
+                    string ans;
+                    read([&ans](const char *data, UInt64 len) {
+                        ans.append(data, len);
+                    });
+                    return ans;
+                }
+
+                // Writes start at the beginning of the LOB, overwriting it, unless seekToEnd is called first.
+                void write(const char *data, UInt64 len) {
+                    _pending.append(data, len);
+                    if (_pending.size() >= (size_t) _chunkSize * _chunksPerCall) {
+                        writePending(False);
+                    }
+                }
+
+                void write(const string &data) {
+                    write(data.data(), data.length());
+                }
+
+                void write(std::istream &in) {
+                    std::vector<char> buffer((size_t) _chunkSize * _chunksPerCall);
+                    while (in) {
+                        in.read(buffer.data(), (std::streamsize) buffer.size());
+                        std::streamsize len = in.gcount();
+                        if (len <= 0) {
+                            break;
+                        }
+                        write(buffer.data(), (UInt64) len);
+                    }
+                }
+
+                void seekToEnd() {
+                    writePending(True);
+                    _writeOffset = size() + 1;
+                }
+
+                // Cuts the LOB to newSize (characters or bytes), and continues writing from there.
+                void truncate(UInt64 newSize) {
+                    _pending.clear();
+                    if (dpiLob_trim(_lob, newSize) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _writeOffset = newSize + 1;
+                }
+
+                // Writes whatever is still buffered.
+                void close() {
+                    writePending(True);
+
+                    if (_opened == True) {
+                        _opened = False;
+                        if (dpiLob_closeResource(_lob) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                    }
+                }
+
+                virtual ~LobStream() {
+                    try {
+                        if (_lob) {
+                            close();
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+
+                    try {
+                        if (_lob) {
+                            dpiLob_release(_lob);
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+            };
+
+            // Typed decoders
+            // =========================================================================
+            // One specialization per C++ type that can be read with ResultSet::rows<T...>(). Each one declares the
+            // native type the column is defined with, and which Oracle types can be fetched as such. Since the driver
+            // already converts each cell to nativeTypeNum, decode() reads the dpiData union member without checking.
+
+            template<typename T>
+            struct ColumnDecoder;
+
+            template<>
+            struct ColumnDecoder<Int64> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_INT64;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return type == DPI_ORACLE_TYPE_NUMBER || type == DPI_ORACLE_TYPE_NATIVE_INT;
+                }
+
+                static Int64 decode(dpiData *data, unsigned int) {
+                    return data->value.asInt64;
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<UInt64> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_UINT64;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return type == DPI_ORACLE_TYPE_NUMBER || type == DPI_ORACLE_TYPE_NATIVE_UINT;
+                }
+
+                static UInt64 decode(dpiData *data, unsigned int) {
+                    return data->value.asUint64;
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<Int32> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_INT64;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return ColumnDecoder<Int64>::accepts(type);
+                }
+
+                static Int32 decode(dpiData *data, unsigned int col) {
+                    return checkedInt32(data->value.asInt64, col);
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<double> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_DOUBLE;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return type == DPI_ORACLE_TYPE_NUMBER ||
+                           type == DPI_ORACLE_TYPE_NATIVE_DOUBLE ||
+                           type == DPI_ORACLE_TYPE_NATIVE_FLOAT;
+                }
+
+                static double decode(dpiData *data, unsigned int) {
+                    return data->value.asDouble;
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<string> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_BYTES;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    switch (type) {
+                        case DPI_ORACLE_TYPE_VARCHAR:
+                        case DPI_ORACLE_TYPE_NVARCHAR:
+                        case DPI_ORACLE_TYPE_CHAR:
+                        case DPI_ORACLE_TYPE_NCHAR:
+                        case DPI_ORACLE_TYPE_LONG_VARCHAR:
+                        case DPI_ORACLE_TYPE_RAW:
+                        case DPI_ORACLE_TYPE_LONG_RAW:
+                        case DPI_ORACLE_TYPE_ROWID:
+                        case DPI_ORACLE_TYPE_NUMBER:
+                            return true;
+                        default:
+                            return false;
+                    }
+                }
+
+                static string decode(dpiData *data, unsigned int) {
+                    return string{data->value.asBytes.ptr, data->value.asBytes.length};
+                }
+            };
+
+            struct TimestampColumnDecoder {
+                static constexpr dpiNativeTypeNum nativeTypeNum = DPI_NATIVE_TYPE_TIMESTAMP;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return type == DPI_ORACLE_TYPE_DATE ||
+                           type == DPI_ORACLE_TYPE_TIMESTAMP ||
+                           type == DPI_ORACLE_TYPE_TIMESTAMP_TZ ||
+                           type == DPI_ORACLE_TYPE_TIMESTAMP_LTZ;
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<Date> : TimestampColumnDecoder {
+                static Date decode(dpiData *data, unsigned int) {
+                    return timestampToDate(data->value.asTimestamp);
+                }
+            };
+
+            template<>
+            struct ColumnDecoder<DateTime> : TimestampColumnDecoder {
+                static DateTime decode(dpiData *data, unsigned int) {
+                    return timestampToDateTime(data->value.asTimestamp);
+                }
+            };
+
+            // NULL is only allowed through std::optional. The non optional decoders are never given a NULL cell.
+            template<typename T>
+            struct ColumnDecoder<optional<T>> {
+                static constexpr dpiNativeTypeNum nativeTypeNum = ColumnDecoder<T>::nativeTypeNum;
+
+                static bool accepts(dpiOracleTypeNum type) {
+                    return ColumnDecoder<T>::accepts(type);
+                }
+
+                static optional<T> decode(dpiData *data, unsigned int col) {
+                    if (data->isNull) {
+                        return std::nullopt;
+                    }
+                    return ColumnDecoder<T>::decode(data, col);
+                }
+            };
+
+            template<typename T>
+            struct ColumnNullable {
+                static constexpr bool value = false;
+            };
+
+            template<typename T>
+            struct ColumnNullable<optional<T>> {
+                static constexpr bool value = true;
+            };
+            // =========================================================================
+
+            // Record mapping
+            // =========================================================================
+            // Describes the fields of a struct once, for ResultSet::records<S>() and DBStatement::setRecord(). Each
+            // field has a name, which is both its column in the select list and its bind parameter, and a type with a
+            // ColumnDecoder; std::optional fields map to NULL.
+            //
+            //   struct Order { Int64 id; string customer; optional<DateTime> shipped; };
+            //   DPIW_RECORD(Order, mapField("ID", &Order::id),
+            //                      mapField("CUSTOMER", &Order::customer),
+            //                      mapField("SHIPPED", &Order::shipped));
+            //
+            // The fields are a constexpr tuple, so binding and decoding a record unroll into one call per field.
+
+            template<typename S, typename T>
+            struct FieldMapping {
+                using Type = T;
+
+                const char *name;
+                T S::*member;
+            };
+
+            template<typename S, typename T>
+            constexpr FieldMapping<S, T> mapField(const char *name, T S::*member) {
+                return {name, member};
+            }
+
+            template<typename S>
+            struct RecordMapping;
+
+            #define DPIW_RECORD(S, ...)                                                    \
+                template<>                                                                 \
+                struct ylib::db::dpiw::RecordMapping<S> {                                  \
+                    static constexpr auto fields = std::make_tuple(__VA_ARGS__);           \
+                }
+            // =========================================================================
+
+            struct ColumnInfo {
+                UInt32 index; //1-based
+                string name;
+                dpiDataTypeInfo typeInfo; //oracle type, precision, scale, sizes...
+                Bool nullable;
+            };
+
+            /*
+             * The columns of a query, as described by dpiStmt_getQueryInfo, plus a name to index table. It's built once
+             * per statement handle and shared by all of its executions, including the ones made after the handle comes
+             * back from the StatementCache.
+             */
+            class QueryMetadata {
+            private:
+                // Names up to this long are upper cased on the stack; Oracle identifiers are at most 128 bytes.
+                static constexpr size_t MAX_NAME = 256;
+
+                // ASCII only, as Oracle upper cases unquoted identifiers; cheaper than std::toupper in the row loop.
+                static char fold(char c) {
+                    return c >= 'a' && c <= 'z' ? (char) (c - 'a' + 'A') : c;
+                }
+
+                struct IndexEntry {
+                    UInt32 index;
+                    Bool upper; //the name is in upper case, as any unquoted identifier, so any case finds it
+                };
+
+                std::vector<ColumnInfo> _columns;
+                std::vector<string> _upper; //the names in upper case, which _index points into
+                std::unordered_map<std::string_view, IndexEntry> _index; //by upper case name
+                Bool _caseCollisions{False}; //quoted names that only differ in case
+
+                optional<UInt32> findUpper(std::string_view name, std::string_view upper) const {
+                    auto it = _index.find(upper);
+                    if (it == _index.end()) {
+                        return std::nullopt;
+                    }
+
+                    const IndexEntry &entry = it->second;
+                    if (entry.upper == True && _caseCollisions == False) {
+                        return entry.index;
+                    }
+
+                    // A quoted name: only the exact one finds it.
+                    for (const ColumnInfo &column: _columns) {
+                        if (column.name == name) {
+                            return column.index;
+                        }
+                    }
+                    return entry.upper == True ? optional<UInt32>{entry.index} : std::nullopt;
+                }
+
+            public:
+                QueryMetadata(dpiContext *ctx, dpiStmt *stmt, UInt32 columnCount) {
+                    _columns.reserve(columnCount);
+                    for (UInt32 pos = 1; pos <= columnCount; pos++) {
+                        dpiQueryInfo info;
+                        if (dpiStmt_getQueryInfo(stmt, pos, &info) == DPI_FAILURE) {
+                            throw DBException::build(ctx);
+                        }
+
+                        _columns.push_back({pos, string{info.name, info.nameLength}, info.typeInfo,
+                                            info.nullOk ? True : False});
+                    }
+
+                    // Only once _upper is complete, so the views don't move.
+                    _upper.reserve(columnCount);
+                    for (ColumnInfo &column: _columns) {
+                        _upper.push_back(column.name);
+                        for (char &c: _upper.back()) {
+                            c = fold(c);
+                        }
+                    }
+
+                    _index.reserve(columnCount);
+                    for (ColumnInfo &column: _columns) {
+                        const string &upper = _upper[column.index - 1];
+                        IndexEntry entry{column.index, column.name == upper ? True : False};
+                        auto res = _index.emplace(upper, entry);
+                        if (res.second == false) {
+                            _caseCollisions = True;
+                            if (entry.upper == True) {
+                                res.first->second = entry; //the unquoted one wins
+                            }
+                        }
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed, the index points into _upper
+                QueryMetadata(const QueryMetadata &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                QueryMetadata &operator=(const QueryMetadata &other) = delete;
+                // =========================================================================
+
+                UInt32 columnCount() const {
+                    return (UInt32) _columns.size();
+                }
+
+                const ColumnInfo &column(UInt32 index) const {
+                    checkParamIsPositive("index", index);
+
+                    if (index > _columns.size()) {
+                        throw DBException(sfput("Column {} is outside of the query. The query has {} columns.",
+                                                index, _columns.size()));
+                    }
+                    return _columns[index - 1];
+                }
+
+                /*
+                 * Unquoted identifiers are stored by Oracle in upper case, so when the exact name is not found, its upper
+                 * case version is tried as well. The names are upper cased once, when the metadata is built, and the
+                 * one looked up on the stack, so each lookup is a single hash, without allocating.
+                 */
+                optional<UInt32> find(std::string_view name) const {
+                    size_t lower = 0;
+                    while (lower < name.size() && fold(name[lower]) == name[lower]) {
+                        lower++;
+                    }
+                    if (lower == name.size()) {
+                        return findUpper(name, name); //already in upper case
+                    }
+
+                    if (name.size() > MAX_NAME) {
+                        string upper{name};
+                        for (char &c: upper) {
+                            c = fold(c);
+                        }
+                        return findUpper(name, upper);
+                    }
+
+                    char upper[MAX_NAME];
+                    for (size_t i = 0; i < name.size(); i++) {
+                        upper[i] = fold(name[i]);
+                    }
+                    return findUpper(name, {upper, name.size()});
+                }
+
+                UInt32 indexOf(std::string_view name) const {
+                    optional<UInt32> index = find(name);
+                    if (index.has_value() == false) {
+                        throw DBException(sfput("Column {} not found in the query.", string{name}));
+                    }
+                    return index.value();
+                }
+            };
+
+            // Where the metadata of a statement handle is kept between its executions. It's filled by the first
+            // ResultSet that describes the query, and shared by the statement, its ResultSets and the StatementCache,
+            // so that any of them may be gone first.
+            typedef std::shared_ptr<std::shared_ptr<QueryMetadata>> MetadataSlot;
+
+            class BatchCursor;
+
+            template<typename... T>
+            class TypedRows;
+
+            template<typename S>
+            class RecordRows;
+
+            class RowBlock;
+
+            // Tag of the ResultSet constructor that takes a statement the server already executed, e.g. a REF cursor.
+            struct Executed {
+            };
+
+            /*
+             * A view over a block of rows fetched in a single dpiStmt_fetchRows call. The cells are read straight from
+             * the dpiData arrays of the variables defined by the ResultSet, so no driver call is made per cell.
+             *
+             * The view doesn't own anything, and it's only valid until the next call to ResultSet::nextBatch or
+             * ResultSet::next, or until the ResultSet is destroyed. Rows and columns are both 1-based, like the rest of
+             * the API.
+             */
+            class RowBatch {
+            private:
+                dpiData **_columns = nullptr; //not owned, one dpiData array per column
+                const dpiNativeTypeNum *_types = nullptr; //not owned
+                UInt32 _columnCount = 0;
+                UInt32 _offset = 0; //bufferRowIndex of the first row in the block
+                UInt32 _rowCount = 0;
+                Bool _more{False};
+
+                void checkColumn(unsigned int col) const {
+                    checkParamIsPositive("col", col);
+
+                    if (col > _columnCount) {
+                        throw DBException(sfput("Column {} is outside of the batch. The batch has {} columns.",
+                                                col, _columnCount));
+                    }
+                }
+
+                dpiData *cell(unsigned int row, unsigned int col) const {
+                    checkParamIsPositive("row", row);
+
+                    if (row > _rowCount) {
+                        throw DBException(sfput("Row {} is outside of the batch. The batch has {} rows.",
+                                                row, _rowCount));
+                    }
+
+                    checkColumn(col);
+                    return &_columns[col - 1][_offset + row - 1];
+                }
+
+                dpiNativeTypeNum type(unsigned int col) const {
+                    return _types[col - 1];
+                }
+
+                friend class BatchCursor;
+
+            public:
+                RowBatch() = default;
+
+                RowBatch(dpiData **columns,
+                         const dpiNativeTypeNum *types,
+                         UInt32 columnCount,
+                         UInt32 offset,
+                         UInt32 rowCount,
+                         Bool more) : _columns{columns},
+                                      _types{types},
+                                      _columnCount{columnCount},
+                                      _offset{offset},
+                                      _rowCount{rowCount},
+                                      _more{more} {
+
+                }
+
+                UInt32 rowCount() const {
+                    return _rowCount;
+                }
+
+                UInt32 columnCount() const {
+                    return _columnCount;
+                }
+
+                Bool empty() const {
+                    return _rowCount == 0 ? True : False;
+                }
+
+                // Whether the driver reported that more rows are available after this block.
+                Bool hasMore() const {
+                    return _more;
+                }
+
+                // The native type the column was fetched as, to pick a reader once per column instead of once per cell.
+                dpiNativeTypeNum nativeTypeNum(unsigned int col) const {
+                    checkColumn(col);
+                    return type(col);
+                }
+
+                // The column's cells for the rows of this batch, as a contiguous array of rowCount() elements.
+                dpiData *column(unsigned int col) const {
+                    checkColumn(col);
+                    return _columns[col - 1] + _offset;
+                }
+
+                Bool isNull(unsigned int row, unsigned int col) const {
+                    return cell(row, col)->isNull ? True : False;
+                }
+
+                string getString(unsigned int row, unsigned int col) const {
+                    return dataToString(cell(row, col), type(col), col);
+                }
+
+                optional<string> getStringOpt(unsigned int row, unsigned int col) const {
+                    dpiData *data = cell(row, col);
+                    if (data->isNull) {
+                        return std::nullopt;
+                    }
+                    return dataToString(data, type(col), col);
+                }
+
+                // Valid until the next batch is fetched.
+                std::string_view getStringView(unsigned int row, unsigned int col) const {
+                    return dataToStringView(cell(row, col), type(col), col);
+                }
+
+                optional<std::string_view> getStringViewOpt(unsigned int row, unsigned int col) const {
+                    dpiData *data = cell(row, col);
+                    if (data->isNull) {
+                        return std::nullopt;
+                    }
+                    return dataToStringView(data, type(col), col);
+                }
+
+                Int64 getInt64(unsigned int row, unsigned int col) const {
+                    return dataToInt64(cell(row, col), type(col), col);
+                }
+
+                UInt64 getUInt64(unsigned int row, unsigned int col) const {
+                    return dataToUInt64(cell(row, col), type(col), col);
+                }
+
+                Int32 getInt32(unsigned int row, unsigned int col) const {
+                    return checkedInt32(getInt64(row, col), col);
+                }
+
+                double getDouble(unsigned int row, unsigned int col) const {
+                    return dataToDouble(cell(row, col), type(col), col);
+                }
+
+                Date getDate(unsigned int row, unsigned int col) const {
+                    dpiTimestamp timestamp = dataToTimestamp(cell(row, col), type(col), col);
+                    return timestampToDate(timestamp);
+                }
+
+                DateTime getDateTime(unsigned int row, unsigned int col) const {
+                    dpiTimestamp timestamp = dataToTimestamp(cell(row, col), type(col), col);
+                    return timestampToDateTime(timestamp);
+                }
+            };
+
+            class ResultSet {
+            private:
+                dpiContext *_ctx = nullptr; //not owned
+                dpiConn *_conn = nullptr; //not owned
+                dpiStmt *_stmt = nullptr; //not owned, unless _ownsStmt
+                Bool _ownsStmt{False};
+                Bool _found{False};
+                Bool _fetched{False};
+
+                //column based
+                //---------------------------------------------
+                dpiData *_data = nullptr; //not owned
+                unsigned int _col = 0;
+                UInt32 _columnCount = 0;
+                dpiNativeTypeNum _nativeTypeNum;
+                //---------------------------------------------
+
+                //batch fetch, one define variable per column
+                //---------------------------------------------
+                std::vector<dpiVar *> _vars;
+                std::vector<dpiData *> _varsData; //owned by the variables
+                std::vector<dpiNativeTypeNum> _varsTypes;
+                //---------------------------------------------
+
+                std::shared_ptr<QueryMetadata> _metadata;
+                MetadataSlot _sharedMetadata; //the statement's
+                Bool _inlineLobs{False};
+                std::vector<dpiNativeTypeNum> _defines; //set by defineColumn, 0 for the driver's default
+
+                //metrics and slow query log, only when enabled
+                //---------------------------------------------
+                StatementMetrics *_metrics = nullptr; //not owned
+                std::optional<SlowQueryTrace> _trace; //a copy of the statement's, so it can outlive it
+                UInt32 _fetchArraySize = 0;
+                UInt32 _bufferRowIndex = 0; //of the last row fetched by next()
+                UInt64 _fetchNanos = 0;
+                UInt64 _rowsFetched = 0;
+                UInt64 _bytesFetched = 0;
+                std::optional<std::vector<UInt32>> _bytesColumns; //counted by next(), known after the first row
+                //---------------------------------------------
+
+                // The Oracle type a column is actually fetched as.
+                dpiOracleTypeNum fetchType(const dpiDataTypeInfo &type) {
+                    dpiOracleTypeNum inlineType;
+                    if (_inlineLobs == True && lobInlineType(type.oracleTypeNum, inlineType) == True) {
+                        return inlineType;
+                    }
+                    return type.oracleTypeNum;
+                }
+
+                // nativeTypes, when given, holds the native type to fetch each column as, or 0 for the driver's
+                // default for the column, which is also used when not given.
+                void defineColumns(const dpiNativeTypeNum *nativeTypes = nullptr) {
+                    if (_fetched == True) {
+                        throw DBException("Can not start a batch fetch, rows were already fetched with next().");
+                    }
+
+                    if (_vars.empty() == false) {
+                        throw DBException("The columns of this ResultSet are already defined.");
+                    }
+
+                    uint32_t arraySize;
+                    if (dpiStmt_getFetchArraySize(_stmt, &arraySize) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    // The variables must hold at least fetch array size rows, since that's how many rows the driver
+                    // will place in them on each round trip.
+                    _vars.reserve(_columnCount);
+                    _varsData.reserve(_columnCount);
+                    _varsTypes.reserve(_columnCount);
+                    const QueryMetadata &meta = metadata();
+                    for (UInt32 pos = 1; pos <= _columnCount; pos++) {
+                        const dpiDataTypeInfo &type = meta.column(pos).typeInfo;
+                        dpiOracleTypeNum oracleTypeNum = fetchType(type);
+                        dpiNativeTypeNum nativeTypeNum = type.defaultNativeTypeNum;
+                        if (nativeTypes && nativeTypes[pos - 1] != 0) {
+                            nativeTypeNum = nativeTypes[pos - 1];
+                        } else if (_defines.empty() == false && _defines[pos - 1] != 0) {
+                            nativeTypeNum = _defines[pos - 1];
+                        } else if (oracleTypeNum != type.oracleTypeNum) {
+                            nativeTypeNum = DPI_NATIVE_TYPE_BYTES; //inline LOB
+                        }
+
+                        dpiVar *column;
+                        dpiData *data;
+                        if (dpiConn_newVar(_conn, oracleTypeNum, nativeTypeNum, arraySize,
+                                           type.clientSizeInBytes, 1, 0, type.objectType, &column, &data) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+
+                        _vars.push_back(column);
+                        _varsData.push_back(data);
+                        _varsTypes.push_back(nativeTypeNum);
+
+                        if (dpiStmt_define(_stmt, pos, column) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                    }
+                }
+
+
+                void fetchCol(unsigned int col) {
+                    checkParamIsPositive("col", col);
+
+                    if (_found == False) {
+                        throw DBException("Can not fetch column, no rows currently available.");
+                    }
+
+                    /*
+                     * https://oracle.github.io/odpi/doc/functions/dpiStmt.html#c.dpiStmt_getQueryValue
+                     * From Oracle ODPI documentation:
+                     * data [OUT] – a pointer to a reference to an internally created dpiData structure which will be populated
+                     * upon successful completion of this function. The structure contains the value of the column at the specified
+                     * position. Note that any references to LOBs, statements, objects and rowids are owned by the statement.
+                     *
+                     * That means, that we don't own the _data pointer, and should not free it ourselves.
+                     */
+                    _col = col;
+                    if (dpiStmt_getQueryValue(_stmt, col, &_nativeTypeNum, &_data) < 0) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                // Adds the string and raw values of the current row to _bytesFetched, each cell once whether it's read
+                // or not, as nextBatch does. The first row tells which columns are BYTES, the next ones only read
+                // those. Returns False when the call fails.
+                Bool countRowBytes() {
+                    dpiNativeTypeNum nativeTypeNum;
+                    dpiData *data;
+                    if (_bytesColumns.has_value() == false) {
+                        _bytesColumns.emplace();
+                        for (UInt32 col = 1; col <= _columnCount; col++) {
+                            if (dpiStmt_getQueryValue(_stmt, col, &nativeTypeNum, &data) < 0) {
+                                return False;
+                            }
+                            if (nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+                                _bytesColumns->push_back(col);
+                            }
+                        }
+                    }
+
+                    for (UInt32 col: *_bytesColumns) {
+                        if (dpiStmt_getQueryValue(_stmt, col, &nativeTypeNum, &data) < 0) {
+                            return False;
+                        }
+                        _bytesFetched += data->isNull ? 0 : data->value.asBytes.length;
+                    }
+                    return True;
+                }
+
+                // Fetches the next row into _found. Returns False when the call fails, with the error left for
+                // DBException::build or DBError::last.
+                Bool fetchRow() {
+                    int found; //boolean
+                    uint32_t bufferRowIndex; //only used for timing
+
+                    // Only the calls that may go to the server are timed: the first one, and the ones past the end of
+                    // the fetch buffer. The rest are served from memory, and timing them would cost more than they do.
+                    Bool timed = (_metrics || _trace) &&
+                                 (_fetched == False || _bufferRowIndex + 1 >= _fetchArraySize) ? True : False;
+                    UInt64 start = timed == True ? monotonicNanos() : 0;
+                    if (dpiStmt_fetch(_stmt, &found, &bufferRowIndex) < 0) {
+                        return False;
+                    }
+
+                    if (_metrics || _trace) {
+                        _fetchNanos += timed == True ? monotonicNanos() - start : 0;
+                        _bufferRowIndex = bufferRowIndex;
+                        _rowsFetched += found ? 1 : 0;
+                    }
+
+                    _fetched = True;
+                    _found = found ? True : False;
+                    if (_metrics && _found == True) {
+                        return countRowBytes();
+                    }
+                    return True;
+                }
+
+            public:
+                // sharedMetadata, when given, is where the metadata of previous executions of the same statement
+                // handle is kept. It's reused as long as the column count still matches. metrics, when given, gets
+                // the execute time, and the fetch time, rows and bytes once the ResultSet is destroyed. So does a copy
+                // of trace, which is then handed to its slow query log.
+                ResultSet(dpiContext *ctx,
+                          dpiConn *conn,
+                          dpiStmt *stmt,
+                          MetadataSlot sharedMetadata = nullptr,
+                          StatementMetrics *metrics = nullptr,
+                          SlowQueryTrace *trace = nullptr) {
+                    _ctx = ctx;
+                    _conn = conn;
+                    _stmt = stmt;
+                    _sharedMetadata = std::move(sharedMetadata);
+                    _metrics = metrics;
+                    if (trace) {
+                        _trace = *trace;
+                    }
+
+                    UInt64 start = _metrics || _trace ? monotonicNanos() : 0;
+                    if (dpiStmt_execute(_stmt, DPI_MODE_EXEC_DEFAULT, &_columnCount) < 0) {
+                        DBException ex = DBException::build(_ctx);
+                        throw ex;
+                    }
+                    if (_metrics || _trace) {
+                        UInt64 elapsed = monotonicNanos() - start;
+                        if (_metrics) {
+                            _metrics->execute.record(elapsed);
+                        }
+                        if (_trace) {
+                            _trace->executeNanos = elapsed;
+                        }
+                        if (dpiStmt_getFetchArraySize(_stmt, &_fetchArraySize) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                    }
+
+                    if (_sharedMetadata && *_sharedMetadata && (*_sharedMetadata)->columnCount() == _columnCount) {
+                        _metadata = *_sharedMetadata;
+                    }
+                }
+
+                // Takes over a reference to stmt, already executed: a REF cursor, or an implicit result. It's
+                // released along with the ResultSet.
+                ResultSet(dpiContext *ctx, dpiConn *conn, dpiStmt *stmt, Executed) {
+                    _ctx = ctx;
+                    _conn = conn;
+                    _stmt = stmt;
+                    _ownsStmt = True;
+
+                    if (dpiStmt_getNumQueryColumns(_stmt, &_columnCount) == DPI_FAILURE) {
+                        DBException ex = DBException::build(_ctx);
+                        dpiStmt_release(_stmt);
+                        throw ex;
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                ResultSet(const ResultSet &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                ResultSet &operator=(const ResultSet &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                UInt32 columnCount() {
+                    return _columnCount;
+                }
+
+                /*
+                 * Rows per round trip, for this ResultSet only. Mostly for REF cursors and implicit results, which
+                 * don't take it from a DBStatement; for regular queries see DBStatement::setFetchArraySize. Must be
+                 * called before the first fetch.
+                 */
+                void setFetchArraySize(UInt32 size) {
+                    checkParamIsPositive("size", size);
+
+                    if (_fetched == True) {
+                        throw DBException("The fetch array size must be set before the first fetch.");
+                    }
+
+                    if (dpiStmt_setFetchArraySize(_stmt, size) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _fetchArraySize = size;
+                }
+
+                // Described on first use, then cached along with the statement handle.
+                const QueryMetadata &metadata() {
+                    if (_metadata == nullptr) {
+                        _metadata = std::make_shared<QueryMetadata>(_ctx, _stmt, _columnCount);
+                        if (_sharedMetadata) {
+                            *_sharedMetadata = _metadata;
+                        }
+                    }
+                    return *_metadata;
+                }
+
+                // Resolve the index once, outside of the row loop, to skip even the hash lookup of the by-name getters.
+                UInt32 columnIndex(std::string_view name) {
+                    return metadata().indexOf(name);
+                }
+
+                // The cell as the driver holds it, valid until the next fetch. For passing values along without
+                // converting them, e.g. to DBStatement::setData.
+                const dpiData &getData(unsigned int col, dpiNativeTypeNum &nativeTypeNum) {
+                    fetchCol(col);
+                    nativeTypeNum = _nativeTypeNum;
+                    return *_data;
+                }
+
+                Bool next() {
+                    if (fetchRow() == False) {
+                        throw DBException::build(_ctx);
+                    }
+                    return _found;
+                }
+
+                // Same as next(), but a failure is returned instead of thrown.
+                DBResult<Bool> tryNext() {
+                    if (fetchRow() == False) {
+                        return DBError::last(_ctx);
+                    }
+                    return _found;
+                }
+
+
+                /*
+                 * Fetches up to maxRows rows in a single call, and returns a view over them. The driver fills its
+                 * buffers in round trips of fetch array size rows (see DBStatement::setFetchArraySize), so maxRows is
+                 * capped by that value. An empty batch means the ResultSet is exhausted.
+                 *
+                 * The first call defines one variable per column, therefore it must be made before any call to next().
+                 * Calling next() afterwards is fine, although the positional getters are not valid until it returns True.
+                 */
+                RowBatch nextBatch(UInt32 maxRows) {
+                    checkParamIsPositive("maxRows", maxRows);
+
+                    if (_vars.empty() && _columnCount > 0) {
+                        defineColumns();
+                    }
+
+                    uint32_t bufferRowIndex;
+                    uint32_t numRowsFetched;
+                    int moreRows; //boolean
+                    UInt64 start = _metrics || _trace ? monotonicNanos() : 0;
+                    if (dpiStmt_fetchRows(_stmt, maxRows, &bufferRowIndex, &numRowsFetched, &moreRows) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    if (_metrics || _trace) {
+                        _fetchNanos += monotonicNanos() - start;
+                        _rowsFetched += numRowsFetched;
+                    }
+                    if (_metrics) {
+                        for (UInt32 col = 0; col < _columnCount; col++) {
+                            if (_varsTypes[col] != DPI_NATIVE_TYPE_BYTES) {
+                                continue;
+                            }
+                            dpiData *data = _varsData[col] + bufferRowIndex;
+                            for (UInt32 row = 0; row < numRowsFetched; row++) {
+                                _bytesFetched += data[row].isNull ? 0 : data[row].value.asBytes.length;
+                            }
+                        }
+                    }
+
+                    _fetched = True;
+                    _found = False;
+                    return {_varsData.data(), _varsTypes.data(), _columnCount, bufferRowIndex, numRowsFetched,
+                            moreRows ? True : False};
+                }
+
+                template<typename F>
+                void forEachBatch(UInt32 maxRows, F &&f) {
+                    for (RowBatch batch = nextBatch(maxRows); batch.empty() == False; batch = nextBatch(maxRows)) {
+                        f(batch);
+                    }
+                }
+
+                /*
+                 * Typed access for fixed schemas. The column types are checked once against the query metadata, and
+                 * each column is defined with the native type of its ColumnDecoder, so the rows are decoded without
+                 * any per cell type dispatch. Like nextBatch, it must be called before any call to next().
+                 *
+                 *   auto rows = rs.rows<Int64, string, optional<DateTime>>();
+                 *   std::tuple<Int64, string, optional<DateTime>> row;
+                 *   while (rows.next(row) == True) { ... }
+                 *
+                 * The rows read from this ResultSet, which must outlive them: not available on a temporary.
+                 */
+                template<typename... T>
+                TypedRows<T...> rows() &;
+
+                template<typename... T>
+                TypedRows<T...> rows() && = delete;
+
+                /*
+                 * Typed access by RecordMapping<S>: each field is read from the column of its name, which is looked up
+                 * and checked once, here. The columns not mapped are fetched, but not read. Like nextBatch, it must be
+                 * called before any call to next().
+                 *
+                 *   Order order;
+                 *   auto orders = rs.records<Order>();
+                 *   while (orders.next(order) == True) { ... }
+                 *
+                 * Like rows(), not available on a temporary.
+                 */
+                template<typename S>
+                RecordRows<S> records() &;
+
+                template<typename S>
+                RecordRows<S> records() && = delete;
+
+                /*
+                 * Fetches the remaining rows into a RowBlock, in batches of the fetch array size. Like nextBatch, it
+                 * must be called before any call to next(). LOB columns must be inlined first, see inlineLobs().
+                 *
+                 * When all the rows fit in a single batch they are copied once, into the block. Otherwise each batch
+                 * is copied into a block of its own and they are merged at the end, so at the peak the rows are held
+                 * twice.
+                 */
+                RowBlock materialize();
+
+
+                // LOB columns are read whole, in as many round trips as they need. See inlineLobs and getLob.
+                string getString(unsigned int col) {
+                    fetchCol(col);
+                    if (_nativeTypeNum == DPI_NATIVE_TYPE_LOB) {
+                        LobStream lob{_ctx, _data->value.asLOB};
+                        return lob.readAll();
+                    }
+                    return dataToString(_data, _nativeTypeNum, _col);
+                }
+
+                optional<string> getStringOpt(unsigned int col) {
+                    fetchCol(col);
+                    if (dpiData_getIsNull(_data) == 1) {
+                        return std::nullopt;
+                    }
+                    if (_nativeTypeNum == DPI_NATIVE_TYPE_LOB) {
+                        LobStream lob{_ctx, _data->value.asLOB};
+                        return lob.readAll();
+                    }
+                    return dataToString(_data, _nativeTypeNum, _col);
+                }
+
+                // The stream holds its own reference to the locator, so it can outlive the row.
+                LobStream getLob(unsigned int col, UInt32 chunksPerCall = 16) {
+                    fetchCol(col);
+                    if (_nativeTypeNum != DPI_NATIVE_TYPE_LOB) {
+                        throw DBException(sfput("Column {} is not a LOB. The dpiNativeTypeNum is: {}.",
+                                                col, _nativeTypeNum));
+                    }
+
+                    if (dpiData_getIsNull(_data) == 1) {
+                        throw DBException(sfput("Column {} is NULL, there is no LOB to read.", col));
+                    }
+                    return {_ctx, _data->value.asLOB, True, chunksPerCall};
+                }
+
+                /*
+                 * Fetches the CLOB, NCLOB and BLOB columns inline with the rows, as LONG data, instead of as locators.
+                 * That saves the round trips of reading each LOB, which is what dominates when the LOBs are small. They
+                 * are then read with getString/getStringView like any VARCHAR column. Must be called before the first
+                 * fetch.
+                 */
+                void inlineLobs() {
+                    if (_fetched == True) {
+                        throw DBException("Can not inline LOBs, rows were already fetched.");
+                    }
+
+                    _inlineLobs = True;
+                    const QueryMetadata &meta = metadata();
+                    for (UInt32 pos = 1; pos <= _columnCount; pos++) {
+                        dpiOracleTypeNum inlineType;
+                        if (lobInlineType(meta.column(pos).typeInfo.oracleTypeNum, inlineType) == False) {
+                            continue;
+                        }
+
+                        if (dpiStmt_defineValue(_stmt, pos, inlineType, DPI_NATIVE_TYPE_BYTES, 0, 0, NULL) ==
+                            DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                    }
+                }
+
+                /*
+                 * Fetches the column as nativeTypeNum, instead of the driver's default for its Oracle type: INT64 or
+                 * UINT64 for a NUMBER that holds integers, which otherwise comes back as DOUBLE, and loses precision
+                 * above 2^53, unless it was declared with a precision of 18 or less and no scale. DOUBLE, or BYTES for
+                 * the number as text, are also accepted. The driver converts each value once, as it fetches it, and
+                 * the getters read it as is. Must be called before the first fetch, for next() and nextBatch alike.
+                 */
+                void defineColumn(unsigned int col, dpiNativeTypeNum nativeTypeNum) {
+                    checkParamIsPositive("col", col);
+
+                    if (_fetched == True || _vars.empty() == false) {
+                        throw DBException("Can not define a column, rows were already fetched.");
+                    }
+
+                    if (col > _columnCount) {
+                        throw DBException(sfput("Column {} is outside of the query. The query has {} columns.",
+                                                col, _columnCount));
+                    }
+
+                    if (nativeTypeNum != DPI_NATIVE_TYPE_INT64 && nativeTypeNum != DPI_NATIVE_TYPE_UINT64 &&
+                        nativeTypeNum != DPI_NATIVE_TYPE_DOUBLE && nativeTypeNum != DPI_NATIVE_TYPE_BYTES) {
+                        throw DBException(sfput("Column {} can not be defined as dpiNativeTypeNum {}. Only INT64, "
+                                                "UINT64, DOUBLE and BYTES are supported.", col, nativeTypeNum));
+                    }
+
+                    const dpiDataTypeInfo &type = metadata().column(col).typeInfo;
+                    if (dpiStmt_defineValue(_stmt, col, fetchType(type), nativeTypeNum, type.clientSizeInBytes, 1,
+                                            NULL) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    _defines.resize(_columnCount, 0);
+                    _defines[col - 1] = nativeTypeNum;
+                }
+
+                void defineColumn(std::string_view name, dpiNativeTypeNum nativeTypeNum) {
+                    defineColumn(columnIndex(name), nativeTypeNum);
+                }
+
+                /*
+                 * Same as getString, but without copying: the view points into the driver's fetch buffer. It stays
+                 * valid until the next call to next() (or nextBatch), or until the ResultSet is destroyed. Only for
+                 * character and raw columns.
+                 */
+                std::string_view getStringView(unsigned int col) {
+                    fetchCol(col);
+                    return dataToStringView(_data, _nativeTypeNum, _col);
+                }
+
+                optional<std::string_view> getStringViewOpt(unsigned int col) {
+                    fetchCol(col);
+                    if (dpiData_getIsNull(_data) == 1) {
+                        return std::nullopt;
+                    }
+                    return dataToStringView(_data, _nativeTypeNum, _col);
+                }
+
+                Int64 getInt64(unsigned int col) {
+                    fetchCol(col);
+                    return dataToInt64(_data, _nativeTypeNum, _col);
+                }
+
+                UInt64 getUInt64(unsigned int col) {
+                    fetchCol(col);
+                    return dataToUInt64(_data, _nativeTypeNum, _col);
+                }
+
+                Int32 getInt32(unsigned int col) {
+                    return checkedInt32(getInt64(col), col);
+                }
+
+                Date getDate(unsigned int col) {
+                    fetchCol(col);
+                    dpiTimestamp timestamp = dataToTimestamp(_data, _nativeTypeNum, _col);
+
+                    return timestampToDate(timestamp);
+                }
+
+
+                DateTime getDateTime(unsigned int col) {
+                    fetchCol(col);
+                    dpiTimestamp timestamp = dataToTimestamp(_data, _nativeTypeNum, _col);
+
+                    return timestampToDateTime(timestamp);
+                }
+
+                // By name
+                // =========================================================================
+                string getString(const char *name) {
+                    return getString(columnIndex(name));
+                }
+
+                optional<string> getStringOpt(const char *name) {
+                    return getStringOpt(columnIndex(name));
+                }
+
+                std::string_view getStringView(const char *name) {
+                    return getStringView(columnIndex(name));
+                }
+
+                optional<std::string_view> getStringViewOpt(const char *name) {
+                    return getStringViewOpt(columnIndex(name));
+                }
+
+                Int64 getInt64(const char *name) {
+                    return getInt64(columnIndex(name));
+                }
+
+                UInt64 getUInt64(const char *name) {
+                    return getUInt64(columnIndex(name));
+                }
+
+                Int32 getInt32(const char *name) {
+                    return getInt32(columnIndex(name));
+                }
+
+                Date getDate(const char *name) {
+                    return getDate(columnIndex(name));
+                }
+
+                DateTime getDateTime(const char *name) {
+                    return getDateTime(columnIndex(name));
+                }
+                // =========================================================================
+
+                /*
+                 * Single pass input iterator over the rows: dereferencing it gives the ResultSet itself, positioned on
+                 * the current row. Every copy shares that position, so only the last one incremented is meaningful.
+                 *
+                 *   for (ResultSet &row: stmt.execQuery()) { ... }
+                 *   auto found = std::find_if(rs.begin(), rs.end(), [](ResultSet &r) { return r.getInt64(1) > 10; });
+                 */
+                class RowIterator {
+                private:
+                    ResultSet *_rs = nullptr; //not owned, nullptr at the end
+
+                    void advance() {
+                        if (_rs->next() == False) {
+                            _rs = nullptr;
+                        }
+                    }
+
+                public:
+                    using iterator_category = std::input_iterator_tag;
+                    using value_type = ResultSet;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = ResultSet *;
+                    using reference = ResultSet &;
+
+                    RowIterator() = default;
+
+                    explicit RowIterator(ResultSet *rs) : _rs{rs} {
+                        advance();
+                    }
+
+                    reference operator*() const {
+                        return *_rs;
+                    }
+
+                    pointer operator->() const {
+                        return _rs;
+                    }
+
+                    RowIterator &operator++() {
+                        advance();
+                        return *this;
+                    }
+
+                    RowIterator operator++(int) {
+                        RowIterator ans = *this;
+                        advance();
+                        return ans;
+                    }
+
+                    bool operator==(const RowIterator &other) const {
+                        return _rs == other._rs;
+                    }
+
+                    bool operator!=(const RowIterator &other) const {
+                        return _rs != other._rs;
+                    }
+                };
+
+                // Fetches the first row, so call it once, like next().
+                RowIterator begin() {
+                    return RowIterator{this};
+                }
+
+                RowIterator end() {
+                    return {};
+                }
+
+                // Calls f with each row. Templated, rather than a std::function, so the row body can be inlined.
+                template<typename F>
+                void forEach(F &&f) {
+                    while (next() == True) {
+                        f(*this);
+                    }
+                }
+
+                virtual ~ResultSet() {
+                    if (_metrics && _fetched == True) {
+                        _metrics->fetch.record(_fetchNanos);
+                        _metrics->rows.fetch_add(_rowsFetched, std::memory_order_relaxed);
+                        _metrics->bytes.fetch_add(_bytesFetched, std::memory_order_relaxed);
+                    }
+
+                    if (_trace) {
+                        try {
+                            _trace->fetchNanos = _fetchNanos;
+                            _trace->rows = _rowsFetched;
+                            _trace->log->finish(*_trace);
+                        } catch (std::exception &ex) {
+                            log.error(ex);
+                        }
+                    }
+
+                    for (dpiVar *column: _vars) {
+                        try {
+                            dpiVar_release(column);
+                        } catch (std::exception &ex) {
+                            log.error(ex);
+                        }
+                    }
+
+                    try {
+                        if (_ownsStmt == True) {
+                            dpiStmt_release(_stmt);
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+            };
+
+            // Walks the rows of a ResultSet batch by batch, for the typed readers.
+            class BatchCursor {
+            protected:
+                ResultSet &_rs; //not owned
+                RowBatch _batch;
+                UInt32 _row = 0; //0-based index inside _batch
+
+                explicit BatchCursor(ResultSet &rs) : _rs{rs} {
+
+                }
+
+                // col is 1-based.
+                template<typename C>
+                C decodeCell(unsigned int col) const {
+                    dpiData *data = &_batch._columns[col - 1][_batch._offset + _row];
+                    if constexpr (ColumnNullable<C>::value == false) {
+                        if (data->isNull) {
+                            throw DBException(sfput("Column {} is NULL, use std::optional to read it.", col));
+                        }
+                    }
+                    return ColumnDecoder<C>::decode(data, col);
+                }
+
+                Bool advance() {
+                    if (_batch.empty() == False && _row + 1 < _batch.rowCount()) {
+                        _row++;
+                        return True;
+                    }
+
+                    // An empty batch means the end, even if the last one still had hasMore() set.
+                    _batch = _rs.nextBatch(std::numeric_limits<UInt32>::max());
+                    _row = 0;
+                    return _batch.empty() == True ? False : True;
+                }
+            };
+
+            template<typename... T>
+            class TypedRows : private BatchCursor {
+            private:
+                template<std::size_t... I>
+                std::tuple<T...> decodeRow(std::index_sequence<I...>) const {
+                    return std::tuple<T...>{decodeCell<T>(I + 1)...};
+                }
+
+                template<typename S, std::size_t... I>
+                S decodeStruct(std::index_sequence<I...>) const {
+                    return S{decodeCell<T>(I + 1)...};
+                }
+
+            public:
+                explicit TypedRows(ResultSet &rs) : BatchCursor{rs} {
+
+                }
+
+                Bool next(std::tuple<T...> &row) {
+                    if (advance() == False) {
+                        return False;
+                    }
+                    row = decodeRow(std::index_sequence_for<T...>{});
+                    return True;
+                }
+
+                // Decodes the row into an aggregate whose fields follow the column order.
+                template<typename S>
+                Bool nextInto(S &out) {
+                    if (advance() == False) {
+                        return False;
+                    }
+                    out = decodeStruct<S>(std::index_sequence_for<T...>{});
+                    return True;
+                }
+
+                template<typename F>
+                void forEach(F f) {
+                    while (advance() == True) {
+                        std::tuple<T...> row = decodeRow(std::index_sequence_for<T...>{});
+                        f(row);
+                    }
+                }
+            };
+
+            template<typename... T>
+            TypedRows<T...> ResultSet::rows() & {
+                static_assert(sizeof...(T) > 0, "At least one column type is required.");
+
+                if (sizeof...(T) != _columnCount) {
+                    throw DBException(sfput("The query has {} columns, but {} types were given.",
+                                            _columnCount, sizeof...(T)));
+                }
+
+                using Check = bool (*)(dpiOracleTypeNum);
+                const Check checks[] = {&ColumnDecoder<T>::accepts...};
+                const QueryMetadata &meta = metadata();
+                for (UInt32 pos = 1; pos <= _columnCount; pos++) {
+                    const ColumnInfo &column = meta.column(pos);
+                    if (checks[pos - 1](fetchType(column.typeInfo)) == false) {
+                        throw DBException(sfput("Column {} ({}) has the Oracle type {}, which can not be decoded as "
+                                                "the requested type.", pos, column.name,
+                                                column.typeInfo.oracleTypeNum));
+                    }
+                }
+
+                const dpiNativeTypeNum nativeTypes[] = {ColumnDecoder<T>::nativeTypeNum...};
+                defineColumns(nativeTypes);
+                return TypedRows<T...>{*this};
+            }
+
+            template<typename S>
+            class RecordRows : private BatchCursor {
+            private:
+                using Fields = std::decay_t<decltype(RecordMapping<S>::fields)>;
+                static constexpr std::size_t COUNT = std::tuple_size_v<Fields>;
+
+                std::array<UInt32, COUNT> _positions; //of each field in the select list
+
+                template<std::size_t... I>
+                void decodeRecord(S &out, std::index_sequence<I...>) const {
+                    ((out.*(std::get<I>(RecordMapping<S>::fields).member) =
+                              decodeCell<typename std::tuple_element_t<I, Fields>::Type>(_positions[I])), ...);
+                }
+
+            public:
+                RecordRows(ResultSet &rs, const std::array<UInt32, COUNT> &positions) : BatchCursor{rs},
+                                                                                        _positions{positions} {
+
+                }
+
+                Bool next(S &out) {
+                    if (advance() == False) {
+                        return False;
+                    }
+                    decodeRecord(out, std::make_index_sequence<COUNT>{});
+                    return True;
+                }
+
+                // f is given the same record on every row, overwritten each time.
+                template<typename F>
+                void forEach(F &&f) {
+                    S record{};
+                    while (advance() == True) {
+                        decodeRecord(record, std::make_index_sequence<COUNT>{});
+                        f(record);
+                    }
+                }
+            };
+
+            template<typename S>
+            RecordRows<S> ResultSet::records() & {
+                using Fields = std::decay_t<decltype(RecordMapping<S>::fields)>;
+                static_assert(std::tuple_size_v<Fields> > 0, "The record must map at least one field.");
+
+                const QueryMetadata &meta = metadata();
+                std::array<UInt32, std::tuple_size_v<Fields>> positions;
+                std::vector<dpiNativeTypeNum> nativeTypes(_columnCount, (dpiNativeTypeNum) 0);
+
+                auto resolve = [&](auto &field) {
+                    using T = typename std::decay_t<decltype(field)>::Type;
+
+                    UInt32 pos = meta.indexOf(field.name);
+                    const ColumnInfo &column = meta.column(pos);
+                    if (ColumnDecoder<T>::accepts(fetchType(column.typeInfo)) == false) {
+                        throw DBException(sfput("Column {} ({}) has the Oracle type {}, which can not be decoded as "
+                                                "the type of its field.", pos, column.name,
+                                                column.typeInfo.oracleTypeNum));
+                    }
+                    nativeTypes[pos - 1] = ColumnDecoder<T>::nativeTypeNum;
+                    return pos;
+                };
+
+                std::size_t i = 0;
+                std::apply([&](auto &... field) {
+                    ((positions[i++] = resolve(field)), ...);
+                }, RecordMapping<S>::fields);
+
+                defineColumns(nativeTypes.data());
+                return RecordRows<S>{*this, positions};
+            }
+
+            /*
+             * A whole result set in memory, column-major: an array of fixed width values per column, or, for BYTES
+             * columns, rowCount() + 1 offsets into the column's bytes, so each cell spans offsets[row - 1] to
+             * offsets[row]. Each column also has a NULL bitmap, a set bit being a NULL. Everything, the column layouts
+             * included, is one allocation, freed at once with the block. The arrays can be read directly, see
+             * int64Column and bytesColumn.
+             *
+             * Rows and columns are 1-based. The getters convert like the ResultSet ones.
+             */
+            class RowBlock {
+            private:
+                struct ColumnLayout {
+                    dpiNativeTypeNum nativeTypeNum;
+                    size_t width; //bytes per value, 0 for BYTES
+                    UInt64 *nulls;
+                    char *values; //or the offsets into bytes, for BYTES
+                    char *bytes; //BYTES only
+                    size_t byteCount; //BYTES only
+                };
+
+                std::unique_ptr<UInt64[]> _buffer;
+                std::shared_ptr<QueryMetadata> _metadata;
+                ColumnLayout *_layouts = nullptr; //at the start of the buffer
+                UInt32 _rowCount = 0;
+                UInt32 _columnCount = 0;
+                size_t _size = 0; //bytes of the buffer
+
+                friend class ResultSet;
+
+                // Bytes per value of a fixed width column, or 0 for BYTES. The first bytes of the dpiDataBuffer are
+                // kept, enough for the union member of the native type.
+                static size_t width(dpiNativeTypeNum nativeTypeNum, unsigned int col) {
+                    switch (nativeTypeNum) {
+                        case DPI_NATIVE_TYPE_INT64:
+                        case DPI_NATIVE_TYPE_UINT64:
+                        case DPI_NATIVE_TYPE_DOUBLE:
+                        case DPI_NATIVE_TYPE_FLOAT:
+                        case DPI_NATIVE_TYPE_BOOLEAN:
+                            return 8;
+                        case DPI_NATIVE_TYPE_TIMESTAMP:
+                            return sizeof(dpiTimestamp);
+                        case DPI_NATIVE_TYPE_BYTES:
+                            return 0;
+                        case DPI_NATIVE_TYPE_LOB:
+                            throw DBException(sfput("Column {} is a LOB, call inlineLobs() before materialize().", col));
+                        default:
+                            throw DBException(sfput("Column {} can not be materialized. The dpiNativeTypeNum is: {}.",
+                                                    col, nativeTypeNum));
+                    }
+                }
+
+                static size_t align(size_t size) {
+                    return (size + 7) & ~(size_t) 7;
+                }
+
+                // Lays out a block of rowCount rows, the NULL bitmaps cleared and the values left to fill. byteCounts
+                // holds the bytes of each BYTES column.
+                RowBlock(std::shared_ptr<QueryMetadata> metadata,
+                         UInt32 rowCount,
+                         const dpiNativeTypeNum *types,
+                         UInt32 columnCount,
+                         const size_t *byteCounts) : _metadata{std::move(metadata)},
+                                                     _rowCount{rowCount},
+                                                     _columnCount{columnCount} {
+
+                    // The layouts, then the bitmap, the values and the bytes of each column, each 8 aligned.
+                    size_t bitmapBytes = (rowCount + 63) / 64 * 8;
+                    size_t size = align(sizeof(ColumnLayout) * columnCount);
+                    for (UInt32 i = 0; i < columnCount; i++) {
+                        size_t bytes = width(types[i], i + 1);
+                        size += bitmapBytes;
+                        size += bytes == 0 ? ((size_t) rowCount + 1) * sizeof(UInt64) + align(byteCounts[i])
+                                           : align((size_t) rowCount * bytes);
+                    }
+                    _size = size;
+                    _buffer.reset(new UInt64[_size / 8]);
+
+                    char *base = (char *) _buffer.get();
+                    _layouts = (ColumnLayout *) base;
+                    size_t pos = align(sizeof(ColumnLayout) * columnCount);
+                    for (UInt32 i = 0; i < columnCount; i++) {
+                        ColumnLayout &c = _layouts[i];
+                        c.nativeTypeNum = types[i];
+                        c.width = width(types[i], i + 1);
+
+                        c.nulls = (UInt64 *) (base + pos);
+                        memset(c.nulls, 0, bitmapBytes);
+                        pos += bitmapBytes;
+
+                        c.values = base + pos;
+                        c.bytes = nullptr;
+                        c.byteCount = 0;
+                        if (c.width == 0) {
+                            ((UInt64 *) c.values)[0] = 0;
+                            pos += ((size_t) rowCount + 1) * sizeof(UInt64);
+                            c.bytes = base + pos;
+                            c.byteCount = byteCounts[i];
+                            pos += align(byteCounts[i]);
+                        } else {
+                            pos += align((size_t) rowCount * c.width);
+                        }
+                    }
+                }
+
+                // The rows of batch, as a block of their own. Each cell is copied once, straight from the fetch
+                // buffers.
+                static RowBlock copyOf(std::shared_ptr<QueryMetadata> metadata,
+                                       const RowBatch &batch,
+                                       const dpiNativeTypeNum *types) {
+                    const UInt32 rows = batch.rowCount();
+                    const UInt32 columns = batch.columnCount();
+
+                    std::vector<size_t> byteCounts(columns, 0);
+                    for (UInt32 col = 1; col <= columns; col++) {
+                        if (types[col - 1] == DPI_NATIVE_TYPE_BYTES) {
+                            const dpiData *src = batch.column(col);
+                            for (UInt32 i = 0; i < rows; i++) {
+                                byteCounts[col - 1] += src[i].isNull ? 0 : src[i].value.asBytes.length;
+                            }
+                        }
+                    }
+
+                    RowBlock ans{std::move(metadata), rows, types, columns, byteCounts.data()};
+                    for (UInt32 col = 1; col <= columns; col++) {
+                        const dpiData *src = batch.column(col);
+                        ColumnLayout &c = ans._layouts[col - 1];
+                        for (UInt32 i = 0; i < rows; i++) {
+                            c.nulls[i / 64] |= (UInt64) (src[i].isNull != 0) << (i % 64);
+                        }
+
+                        if (c.width == 8) {
+                            for (UInt32 i = 0; i < rows; i++) {
+                                memcpy(c.values + (size_t) i * 8, &src[i].value, 8);
+                            }
+                        } else if (c.width != 0) {
+                            for (UInt32 i = 0; i < rows; i++) {
+                                memcpy(c.values + (size_t) i * sizeof(dpiTimestamp), &src[i].value,
+                                       sizeof(dpiTimestamp));
+                            }
+                        } else {
+                            UInt64 *offsets = (UInt64 *) c.values;
+                            size_t pos = 0;
+                            for (UInt32 i = 0; i < rows; i++) {
+                                if (src[i].isNull == 0) {
+                                    memcpy(c.bytes + pos, src[i].value.asBytes.ptr, src[i].value.asBytes.length);
+                                    pos += src[i].value.asBytes.length;
+                                }
+                                offsets[i + 1] = pos;
+                            }
+                        }
+                    }
+                    return ans;
+                }
+
+                // The blocks one after the other, in a single one. Each block is freed once copied.
+                static RowBlock concat(std::shared_ptr<QueryMetadata> metadata,
+                                       const dpiNativeTypeNum *types,
+                                       UInt32 columnCount,
+                                       std::vector<RowBlock> &blocks) {
+                    UInt64 rows = 0;
+                    std::vector<size_t> byteCounts(columnCount, 0);
+                    for (RowBlock &block: blocks) {
+                        rows += block._rowCount;
+                        for (UInt32 i = 0; i < columnCount; i++) {
+                            byteCounts[i] += block._layouts[i].byteCount;
+                        }
+                    }
+
+                    RowBlock ans{std::move(metadata), (UInt32) rows, types, columnCount, byteCounts.data()};
+                    const size_t words = ((size_t) ans._rowCount + 63) / 64;
+                    UInt32 first = 0; //0-based row of the block being copied
+                    std::vector<size_t> bytePos(columnCount, 0);
+                    for (RowBlock &block: blocks) {
+                        for (UInt32 i = 0; i < columnCount; i++) {
+                            const ColumnLayout &src = block._layouts[i];
+                            ColumnLayout &dst = ans._layouts[i];
+
+                            // The block's bitmap, shifted to its first row.
+                            const UInt32 shift = first % 64;
+                            for (size_t w = 0; w < ((size_t) block._rowCount + 63) / 64; w++) {
+                                size_t at = first / 64 + w;
+                                dst.nulls[at] |= src.nulls[w] << shift;
+                                if (shift != 0 && at + 1 < words) {
+                                    dst.nulls[at + 1] |= src.nulls[w] >> (64 - shift);
+                                }
+                            }
+
+                            if (dst.width != 0) {
+                                memcpy(dst.values + (size_t) first * dst.width, src.values,
+                                       (size_t) block._rowCount * dst.width);
+                            } else {
+                                const UInt64 *from = (const UInt64 *) src.values;
+                                UInt64 *to = (UInt64 *) dst.values + first;
+                                for (UInt32 row = 1; row <= block._rowCount; row++) {
+                                    to[row] = bytePos[i] + from[row];
+                                }
+                                memcpy(dst.bytes + bytePos[i], src.bytes, src.byteCount);
+                                bytePos[i] += src.byteCount;
+                            }
+                        }
+
+                        first += block._rowCount;
+                        block = RowBlock{};
+                    }
+                    return ans;
+                }
+
+                void outside(unsigned int row, unsigned int col) const {
+                    checkParamIsPositive("row", row);
+                    checkParamIsPositive("col", col);
+
+                    if (row > _rowCount) {
+                        throw DBException(sfput("Row {} is outside of the block. The block has {} rows.",
+                                                row, _rowCount));
+                    }
+                    throw DBException(sfput("Column {} is outside of the block. The block has {} columns.",
+                                            col, _columnCount));
+                }
+
+                const ColumnLayout &layout(unsigned int col) const {
+                    if (col - 1 >= _columnCount) {
+                        outside(1, col);
+                    }
+                    return _layouts[col - 1];
+                }
+
+                // The layout of the cell's column, once both are checked: a single compare each, since row - 1 wraps
+                // around for row 0.
+                const ColumnLayout &layout(unsigned int row, unsigned int col) const {
+                    if (row - 1 >= _rowCount || col - 1 >= _columnCount) {
+                        outside(row, col);
+                    }
+                    return _layouts[col - 1];
+                }
+
+                static Bool isNull(const ColumnLayout &c, unsigned int row) {
+                    return (c.nulls[(row - 1) / 64] >> ((row - 1) % 64)) & 1 ? True : False;
+                }
+
+                // The cell as a dpiData, for the conversions shared with ResultSet.
+                static dpiData cell(const ColumnLayout &c, unsigned int row) {
+                    dpiData ans;
+                    ans.isNull = isNull(c, row) == True ? 1 : 0;
+                    if (c.width == 8) {
+                        memcpy(&ans.value, c.values + (size_t) (row - 1) * 8, 8);
+                    } else if (c.width == 0) {
+                        const UInt64 *offsets = (const UInt64 *) c.values;
+                        ans.value.asBytes.ptr = c.bytes + offsets[row - 1];
+                        ans.value.asBytes.length = (uint32_t) (offsets[row] - offsets[row - 1]);
+                    } else {
+                        memcpy(&ans.value, c.values + (size_t) (row - 1) * sizeof(dpiTimestamp), sizeof(dpiTimestamp));
+                    }
+                    return ans;
+                }
+
+                const ColumnLayout &typedLayout(unsigned int col, dpiNativeTypeNum nativeTypeNum) const {
+                    const ColumnLayout &c = layout(col);
+                    if (c.nativeTypeNum != nativeTypeNum) {
+                        throw DBException(sfput("Column {} has the dpiNativeTypeNum {}, not {}.", col,
+                                                c.nativeTypeNum, nativeTypeNum));
+                    }
+                    return c;
+                }
+
+            public:
+                RowBlock() = default;
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                RowBlock(const RowBlock &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                RowBlock &operator=(const RowBlock &other) = delete;
+
+                // 3. Move Constructor
+                // Allowed, other is left empty
+                RowBlock(RowBlock &&other) noexcept: _buffer{std::move(other._buffer)},
+                                                     _metadata{std::move(other._metadata)},
+                                                     _layouts{std::exchange(other._layouts, nullptr)},
+                                                     _rowCount{std::exchange(other._rowCount, 0)},
+                                                     _columnCount{std::exchange(other._columnCount, 0)},
+                                                     _size{std::exchange(other._size, 0)} {
+
+                }
+
+                // 4. Move Assignment
+                // Allowed, other is left empty
+                RowBlock &operator=(RowBlock &&other) noexcept {
+                    _buffer = std::move(other._buffer);
+                    _metadata = std::move(other._metadata);
+                    _layouts = std::exchange(other._layouts, nullptr);
+                    _rowCount = std::exchange(other._rowCount, 0);
+                    _columnCount = std::exchange(other._columnCount, 0);
+                    _size = std::exchange(other._size, 0);
+                    return *this;
+                }
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                UInt32 rowCount() const {
+                    return _rowCount;
+                }
+
+                UInt32 columnCount() const {
+                    return _columnCount;
+                }
+
+                // Bytes held by the block.
+                size_t size() const {
+                    return _size;
+                }
+
+                const QueryMetadata &metadata() const {
+                    return *_metadata;
+                }
+
+                dpiNativeTypeNum nativeTypeNum(unsigned int col) const {
+                    return layout(col).nativeTypeNum;
+                }
+
+                Bool isNull(unsigned int row, unsigned int col) const {
+                    return isNull(layout(row, col), row);
+                }
+
+                // The NULL bitmap of the column, (rowCount() + 63) / 64 words; row r is bit (r - 1) % 64 of word
+                // (r - 1) / 64.
+                const UInt64 *nullBitmap(unsigned int col) const {
+                    return layout(col).nulls;
+                }
+
+                // The values of an INT64 column, rowCount() of them. Those of the NULL cells are undefined.
+                const Int64 *int64Column(unsigned int col) const {
+                    return (const Int64 *) typedLayout(col, DPI_NATIVE_TYPE_INT64).values;
+                }
+
+                const UInt64 *uint64Column(unsigned int col) const {
+                    return (const UInt64 *) typedLayout(col, DPI_NATIVE_TYPE_UINT64).values;
+                }
+
+                const double *doubleColumn(unsigned int col) const {
+                    return (const double *) typedLayout(col, DPI_NATIVE_TYPE_DOUBLE).values;
+                }
+
+                // The cells of a BYTES column, one after the other, not terminated. Cell r is the bytes from
+                // bytesOffsets(col)[r - 1] to bytesOffsets(col)[r]; NULL cells are empty.
+                const char *bytesColumn(unsigned int col) const {
+                    return typedLayout(col, DPI_NATIVE_TYPE_BYTES).bytes;
+                }
+
+                // rowCount() + 1 offsets into bytesColumn(col), starting at 0.
+                const UInt64 *bytesOffsets(unsigned int col) const {
+                    return (const UInt64 *) typedLayout(col, DPI_NATIVE_TYPE_BYTES).values;
+                }
+
+                // Valid as long as the block.
+                std::string_view getStringView(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return dataToStringView(&data, c.nativeTypeNum, col);
+                }
+
+                optional<std::string_view> getStringViewOpt(unsigned int row, unsigned int col) const {
+                    if (isNull(row, col) == True) {
+                        return std::nullopt;
+                    }
+                    return getStringView(row, col);
+                }
+
+                string getString(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return dataToString(&data, c.nativeTypeNum, col);
+                }
+
+                optional<string> getStringOpt(unsigned int row, unsigned int col) const {
+                    if (isNull(row, col) == True) {
+                        return std::nullopt;
+                    }
+                    return getString(row, col);
+                }
+
+                Int64 getInt64(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return dataToInt64(&data, c.nativeTypeNum, col);
+                }
+
+                UInt64 getUInt64(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return dataToUInt64(&data, c.nativeTypeNum, col);
+                }
+
+                Int32 getInt32(unsigned int row, unsigned int col) const {
+                    return checkedInt32(getInt64(row, col), col);
+                }
+
+                double getDouble(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return dataToDouble(&data, c.nativeTypeNum, col);
+                }
+
+                Date getDate(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return timestampToDate(dataToTimestamp(&data, c.nativeTypeNum, col));
+                }
+
+                DateTime getDateTime(unsigned int row, unsigned int col) const {
+                    const ColumnLayout &c = layout(row, col);
+                    dpiData data = cell(c, row);
+                    return timestampToDateTime(dataToTimestamp(&data, c.nativeTypeNum, col));
+                }
             };
 
-            class ResultSet {
+            inline RowBlock ResultSet::materialize() {
+                if (_columnCount == 0) {
+                    throw DBException("Only queries can be materialized.");
+                }
+                metadata();
+
+                // A result of a single batch is laid out straight from the fetch buffers. A longer one is copied into
+                // one block per batch, each of its exact size, then once more into the final block.
+                std::vector<RowBlock> blocks;
+                UInt64 rows = 0;
+                for (RowBatch batch = nextBatch(std::numeric_limits<UInt32>::max()); batch.empty() == False;
+                     batch = nextBatch(std::numeric_limits<UInt32>::max())) {
+                    if (rows + batch.rowCount() > std::numeric_limits<UInt32>::max()) {
+                        throw DBException("Too many rows to materialize in a single RowBlock.");
+                    }
+
+                    blocks.push_back(RowBlock::copyOf(_metadata, batch, _varsTypes.data()));
+                    rows += batch.rowCount();
+                    if (batch.hasMore() == False) {
+                        break;
+                    }
+                }
+
+                if (blocks.size() == 1) {
+                    return std::move(blocks[0]);
+                }
+                return RowBlock::concat(_metadata, _varsTypes.data(), _columnCount, blocks);
+            }
+
+            // One error of an array DML execution in batch errors mode. row is the 1-based row of the batch.
+            struct BatchError {
+                UInt32 row;
+                Int32 code;
+                string message;
+            };
+
+            /*
+             * An array variable, used to bind a whole batch of rows to a single placeholder. The values are copied into
+             * the variable's own buffers, so the caller doesn't need to keep them alive until the execution. Rows are
+             * 1-based.
+             */
+            class DBVar {
             private:
                 dpiContext *_ctx = nullptr; //not owned
-                dpiStmt *_stmt = nullptr; //not owned
-                Bool _found{False};
-
-                //column based
-                //---------------------------------------------
-                dpiData *_data = nullptr; //not owned
-                unsigned int _col = 0;
-                UInt32 _columnCount = 0;
+                dpiConn *_conn = nullptr; //not owned
+                dpiVar *_var = nullptr;
+                dpiData *_data = nullptr; //owned by _var
                 dpiNativeTypeNum _nativeTypeNum;
-                //---------------------------------------------
+                UInt32 _maxRows = 0;
+
+                dpiData &at(UInt32 row) {
+                    checkParamIsPositive("row", row);
 
+                    if (row > _maxRows) {
+                        throw DBException(sfput("Row {} is outside of the variable. The variable has {} rows.",
+                                                row, _maxRows));
+                    }
+                    return _data[row - 1];
+                }
 
-                double dataToDouble() {
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
-                        return _data->value.asDouble;
+                void checkType(dpiNativeTypeNum nativeTypeNum) {
+                    if (_nativeTypeNum != nativeTypeNum) {
+                        throw DBException(sfput("The variable holds dpiNativeTypeNum {}, not {}.",
+                                                _nativeTypeNum, nativeTypeNum));
                     }
+                }
+
+                dpiData &returned(UInt32 row, UInt32 index) {
+                    checkParamIsPositive("index", index);
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_FLOAT) {
-                        return _data->value.asFloat;
+                    at(row); // bounds check
+                    uint32_t count;
+                    dpiData *data; //owned by _var
+                    if (dpiVar_getReturnedData(_var, row - 1, &count, &data) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
                     }
 
-                    throw Exception(sfput("Could not convert column index {} to double. "
-                                          "The dpiNativeTypeNum is: {}.", _col, _nativeTypeNum));
+                    if (index > count) {
+                        throw DBException(sfput("Value {} was not returned. Row {} returned {} values.",
+                                                index, row, count));
+                    }
+                    return data[index - 1];
                 }
 
-                Int64 dataToInt64() {
+            public:
+                DBVar(dpiContext *ctx,
+                      dpiConn *conn,
+                      dpiOracleTypeNum oracleTypeNum,
+                      dpiNativeTypeNum nativeTypeNum,
+                      UInt32 maxRows,
+                      UInt32 size) {
+                    checkParamIsPositive("maxRows", maxRows);
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_INT64) {
-                        return _data->value.asInt64;
+                    _ctx = ctx;
+                    _conn = conn;
+                    _nativeTypeNum = nativeTypeNum;
+                    _maxRows = maxRows;
+                    if (dpiConn_newVar(conn, oracleTypeNum, nativeTypeNum, maxRows, size, 1, 0, NULL,
+                                       &_var, &_data) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
                     }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                DBVar(const DBVar &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                DBVar &operator=(const DBVar &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, DBStatement hands out references to its variables
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                dpiVar *handle() {
+                    return _var;
+                }
+
+                UInt32 maxRows() {
+                    return _maxRows;
+                }
+
+                void setNull(UInt32 row) {
+                    dpiData_setNull(&at(row));
+                }
+
+                void setInt64(UInt32 row, Int64 val) {
+                    checkType(DPI_NATIVE_TYPE_INT64);
+                    dpiData_setInt64(&at(row), (int64_t) val);
+                }
+
+                void setUInt64(UInt32 row, UInt64 val) {
+                    checkType(DPI_NATIVE_TYPE_UINT64);
+                    dpiData_setUint64(&at(row), val);
+                }
+
+                void setDouble(UInt32 row, double val) {
+                    checkType(DPI_NATIVE_TYPE_DOUBLE);
+                    dpiData_setDouble(&at(row), val);
+                }
+
+                void setString(UInt32 row, std::string_view val) {
+                    checkType(DPI_NATIVE_TYPE_BYTES);
+                    at(row); // bounds check
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
-                        return (Int64) _data->value.asDouble;
+                    // Unlike the other types, the bytes must be copied into the variable's buffer.
+                    if (dpiVar_setFromBytes(_var, row - 1, val.data(), val.length()) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
                     }
+                }
+
+                void setDateTime(UInt32 row, const core::DateTime val) {
+                    checkType(DPI_NATIVE_TYPE_TIMESTAMP);
+
+                    Date date = val.date();
+                    Time time = val.time();
+                    Int32 fractions = time.milli();
+                    fractions = fractions * ((Int32) 1000000);
+                    dpiData_setTimestamp(&at(row), date.year(),
+                                         monthToUInt(date.month()),
+                                         date.day(),
+                                         time.hour(),
+                                         time.min(),
+                                         time.sec(),
+                                         fractions,
+                                         0, 0);
+                }
 
-                    throw Exception(sfput("Could not convert column index {} to Int64. "
-                                          "The dpiNativeTypeNum is: {}.", _col, _nativeTypeNum));
+                void setTimestamp(UInt32 row, const dpiTimestamp &val) {
+                    checkType(DPI_NATIVE_TYPE_TIMESTAMP);
+                    dpiData &data = at(row);
+                    data.isNull = 0;
+                    data.value.asTimestamp = val;
                 }
 
-                UInt64 dataToUInt64() {
+                void setInt64Opt(UInt32 row, std::optional<Int64> opt) {
+                    if (opt.has_value()) {
+                        setInt64(row, opt.value());
+                    } else {
+                        setNull(row);
+                    }
+                }
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_UINT64) {
-                        return _data->value.asUint64;
+                void setDoubleOpt(UInt32 row, std::optional<double> opt) {
+                    if (opt.has_value()) {
+                        setDouble(row, opt.value());
+                    } else {
+                        setNull(row);
                     }
+                }
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
-                        return (UInt64) _data->value.asDouble;
+                void setStringOpt(UInt32 row, std::optional<string> opt) {
+                    if (opt.has_value()) {
+                        setString(row, opt.value());
+                    } else {
+                        setNull(row);
                     }
+                }
 
-                    if(_nativeTypeNum == DPI_NATIVE_TYPE_INT64){
-                        Int64 val = _data->value.asInt64;
-                        if(val < 0){
-                            throw Exception(sfput("Could not convert column index {} to UInt64, "
-                                                  "negative value: {}. The dpiNativeTypeNum is: {}.", _col,
-                                                  val, _nativeTypeNum));
-                        }
-                        return (UInt64)val;
+                void setDateTimeOpt(UInt32 row, const optional<core::DateTime> opt) {
+                    if (opt.has_value()) {
+                        setDateTime(row, opt.value());
+                    } else {
+                        setNull(row);
                     }
+                }
 
-                    throw Exception(sfput("Could not convert column index {} to UInt64. "
-                                          "The dpiNativeTypeNum is: {}.", _col, _nativeTypeNum));
+                // OUT and IN OUT values, after the execution. For RETURNING INTO use the getReturned* methods instead.
+                // =========================================================================
+                Bool isNull(UInt32 row) {
+                    return at(row).isNull ? True : False;
                 }
 
-                dpiTimestamp dataToTimestamp() {
+                Int64 getInt64(UInt32 row) {
+                    return dataToInt64(&at(row), _nativeTypeNum, row);
+                }
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_TIMESTAMP) {
-                        return _data->value.asTimestamp;
-                    }
+                UInt64 getUInt64(UInt32 row) {
+                    return dataToUInt64(&at(row), _nativeTypeNum, row);
+                }
 
-                    throw Exception(sfput("Could not convert column index ${} to dpiTimestamp. "
-                                          "The dpiNativeTypeNum is: ${}.", _col, _nativeTypeNum));
+                double getDouble(UInt32 row) {
+                    return dataToDouble(&at(row), _nativeTypeNum, row);
                 }
 
-                string dataToString() {
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
-                        dpiBytes val = _data->value.asBytes;
-                        UInt32 len = val.length;
-                        char *ptr = val.ptr;
-                        string ans{ptr, len};
-                        return ans;
+                string getString(UInt32 row) {
+                    return dataToString(&at(row), _nativeTypeNum, row);
+                }
+
+                DateTime getDateTime(UInt32 row) {
+                    checkType(DPI_NATIVE_TYPE_TIMESTAMP);
+                    return timestampToDateTime(at(row).value.asTimestamp);
+                }
+
+                // The REF cursor of a variable bound with DBStatement::bindCursor. The ResultSet keeps its own
+                // reference, so it can outlive the variable.
+                ResultSet getCursor(UInt32 row = 1) {
+                    checkType(DPI_NATIVE_TYPE_STMT);
+
+                    dpiData &data = at(row);
+                    if (data.isNull) {
+                        throw DBException(sfput("The cursor of row {} is NULL.", row));
                     }
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_DOUBLE) {
-                        return std::to_string(dataToDouble());
+                    dpiStmt *cursor = data.value.asStmt; //owned by _var
+                    if (dpiStmt_addRef(cursor) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
                     }
+                    return {_ctx, _conn, cursor, Executed{}};
+                }
+                // =========================================================================
 
-                    if (_nativeTypeNum == DPI_NATIVE_TYPE_INT64) {
-                        return std::to_string(dataToInt64());
+                // RETURNING INTO
+                // =========================================================================
+                // Each row of the execution (1 for exec, up to numRows for execMany) returns one value per row it
+                // affected: none when it matched no rows, more than one for an UPDATE or DELETE of several. index is
+                // 1-based, same as row.
+
+                UInt32 returnedCount(UInt32 row) {
+                    at(row); // bounds check
+                    uint32_t count;
+                    dpiData *data;
+                    if (dpiVar_getReturnedData(_var, row - 1, &count, &data) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
                     }
+                    return count;
+                }
 
-                    throw Exception(sfput("Could not convert column index ${} to std::string. "
-                                          "The dpiNativeTypeNum is: ${}.", _col, _nativeTypeNum));
+                Bool isReturnedNull(UInt32 row, UInt32 index = 1) {
+                    return returned(row, index).isNull ? True : False;
                 }
 
-                void fetchCol(unsigned int col) {
-                    checkParamIsPositive("col", col);
+                Int64 getReturnedInt64(UInt32 row, UInt32 index = 1) {
+                    return dataToInt64(&returned(row, index), _nativeTypeNum, row);
+                }
 
-                    if (_found == False) {
-                        throw DBException("Can not fetch column, no rows currently available.");
+                UInt64 getReturnedUInt64(UInt32 row, UInt32 index = 1) {
+                    return dataToUInt64(&returned(row, index), _nativeTypeNum, row);
+                }
+
+                double getReturnedDouble(UInt32 row, UInt32 index = 1) {
+                    return dataToDouble(&returned(row, index), _nativeTypeNum, row);
+                }
+
+                string getReturnedString(UInt32 row, UInt32 index = 1) {
+                    return dataToString(&returned(row, index), _nativeTypeNum, row);
+                }
+
+                DateTime getReturnedDateTime(UInt32 row, UInt32 index = 1) {
+                    checkType(DPI_NATIVE_TYPE_TIMESTAMP);
+                    return timestampToDateTime(returned(row, index).value.asTimestamp);
+                }
+
+                // Every value returned by the first numRows rows, in order. With one value per row, e.g. the keys
+                // generated by a batch of inserts, value i belongs to row i.
+                std::vector<Int64> getReturnedInt64s(UInt32 numRows) {
+                    if (numRows > _maxRows) {
+                        throw DBException(sfput("Row {} is outside of the variable. The variable has {} rows.",
+                                                numRows, _maxRows));
                     }
 
-                    /*
-                     * https://oracle.github.io/odpi/doc/functions/dpiStmt.html#c.dpiStmt_getQueryValue
-                     * From Oracle ODPI documentation:
-                     * data [OUT] – a pointer to a reference to an internally created dpiData structure which will be populated
-                     * upon successful completion of this function. The structure contains the value of the column at the specified
-                     * position. Note that any references to LOBs, statements, objects and rowids are owned by the statement.
-                     *
-                     * That means, that we don't own the _data pointer, and should not free it ourselves.
-                     */
-                    _col = col;
-                    if (dpiStmt_getQueryValue(_stmt, col, &_nativeTypeNum, &_data) < 0) {
-                        throw DBException::build(_ctx);
+                    std::vector<Int64> ans;
+                    ans.reserve(numRows);
+                    for (UInt32 row = 0; row < numRows; row++) {
+                        uint32_t count;
+                        dpiData *data; //owned by _var
+                        if (dpiVar_getReturnedData(_var, row, &count, &data) == DPI_FAILURE) {
+                            throw DBException::build(_ctx);
+                        }
+                        for (uint32_t i = 0; i < count; i++) {
+                            ans.push_back(dataToInt64(data + i, _nativeTypeNum, row + 1));
+                        }
+                    }
+                    return ans;
+                }
+                // =========================================================================
+
+                virtual ~DBVar() {
+                    try {
+                        if (_var) {
+                            dpiVar_release(_var);
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
                     }
                 }
+            };
 
-                tm toTimeGMT(dpiTimestamp& timestamp){
-                    tm t = ctimeGMT();
-                    t.tm_year = timestamp.year - 1900; //tm year is since 1900
-                    t.tm_mon = timestamp.month - 1; //tm month is [0, 11]
-                    t.tm_mday = timestamp.day;
+            /*
+             * The parameters bound on a statement handle, by position and by name. A handle keeps its binds when it
+             * goes back to the StatementCache, so whoever takes it next must bind at least the same parameters, the
+             * same way, or it would run with the values of the previous user.
+             */
+            class BoundParams {
+            private:
+                std::vector<bool> _positions; //col - 1
+                std::vector<string> _names; //without the colon, upper case unless quoted
+
+                // Unquoted names are case insensitive, as in Oracle. name is normalized already, param isn't.
+                static Bool sameName(const string &name, const char *param) {
+                    if (param[0] == '"') {
+                        return name == param ? True : False;
+                    }
 
-                    time_t tt = timegm(&t) +
-                                (timestamp.tzHourOffset * 60 * 60) +
-                                (timestamp.tzMinuteOffset * 60);
+                    size_t i = 0;
+                    for (; i < name.size() && param[i] != '\0'; i++) {
+                        if (name[i] != (char) std::toupper((unsigned char) param[i])) {
+                            return False;
+                        }
+                    }
+                    return i == name.size() && param[i] == '\0' ? True : False;
+                }
 
-                    return *gmtime(&tt);
+                static const char *unprefixed(const char *param) {
+                    return param[0] == ':' ? param + 1 : param;
                 }
 
             public:
-                ResultSet(dpiContext *ctx, dpiStmt *stmt) {
-                    _ctx = ctx;
-                    _stmt = stmt;
-                    if (dpiStmt_execute(_stmt, DPI_MODE_EXEC_DEFAULT, &_columnCount) < 0) {
-                        DBException ex = DBException::build(_ctx);
-                        throw ex;
+                void add(unsigned int col) {
+                    if (col > _positions.size()) {
+                        _positions.resize(col, false);
+                    }
+                    _positions[col - 1] = true;
+                }
+
+                void add(const char *param) {
+                    param = unprefixed(param);
+                    for (const string &name: _names) {
+                        if (sameName(name, param) == True) {
+                            return;
+                        }
+                    }
+
+                    string name{param};
+                    if (param[0] != '"') {
+                        for (char &c: name) {
+                            c = (char) std::toupper((unsigned char) c);
+                        }
+                    }
+                    _names.push_back(std::move(name));
+                }
+
+                void merge(const BoundParams &other) {
+                    for (size_t i = 0; i < other._positions.size(); i++) {
+                        if (other._positions[i]) {
+                            add((unsigned int) i + 1);
+                        }
+                    }
+                    for (const string &name: other._names) {
+                        add(name.c_str());
+                    }
+                }
+
+                // The first parameter of other that isn't bound here, as :1 or :NAME, or empty when there's none.
+                string missing(const BoundParams &other) const {
+                    for (size_t i = 0; i < other._positions.size(); i++) {
+                        if (other._positions[i] && (i >= _positions.size() || _positions[i] == false)) {
+                            return ":" + std::to_string(i + 1);
+                        }
+                    }
+
+                    for (const string &name: other._names) {
+                        Bool found = False;
+                        for (const string &mine: _names) {
+                            if (mine == name) {
+                                found = True;
+                                break;
+                            }
+                        }
+                        if (found == False) {
+                            return ":" + name;
+                        }
+                    }
+                    return "";
+                }
+
+                Bool empty() const {
+                    return _positions.empty() && _names.empty() ? True : False;
+                }
+
+                void clear() {
+                    _positions.clear();
+                    _names.clear();
+                }
+            };
+
+            /*
+             * Per connection LRU cache of prepared statements, keyed by SQL text. A DBStatement checks its handle out of
+             * the cache when it's created, and puts it back when destroyed, so two live DBStatements never share a
+             * handle: if the same SQL is already checked out, the second one is a miss and gets prepared again.
+             *
+             * Statements evicted from here are released to the driver, which keeps them in the OCI statement cache
+             * (sized to match, see DBConnection::setStatementCacheSize) until it also evicts them.
+             *
+             * The cache goes away with its connection. A DBStatement destroyed after the connection releases its
+             * handle instead of putting it back. A handle taken from the cache still has the binds of its previous
+             * user; executing it without binding those parameters again throws, see BoundParams.
+             */
+            class StatementCache {
+            private:
+                struct Entry {
+                    string sql;
+                    dpiStmt *stmt;
+                    MetadataSlot metadata;
+                    BoundParams binds; //still attached to stmt
+                };
+
+                typedef std::list<Entry> Entries;
+
+                UInt32 _capacity = 0;
+                Entries _entries; //most recently used first
+                std::unordered_map<string, Entries::iterator> _index;
+                UInt64 _hits = 0;
+                UInt64 _misses = 0;
+
+                static void release(dpiStmt *stmt) {
+                    try {
+                        dpiStmt_release(stmt);
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+
+                void trim() {
+                    while (_entries.size() > _capacity) {
+                        Entry &last = _entries.back();
+                        _index.erase(last.sql);
+                        release(last.stmt);
+                        _entries.pop_back();
                     }
                 }
 
+            public:
+                explicit StatementCache(UInt32 capacity) : _capacity{capacity} {
+
+                }
+
                 // Rule of five
                 // =========================================================================
                 // 1. Copy Constructor
                 // No copy constructor allowed
-                ResultSet(const ResultSet &) = delete;
+                StatementCache(const StatementCache &) = delete;
 
                 // 2. Copy Assignment
                 // No copy assignment allowed
-                ResultSet &operator=(const ResultSet &other) = delete;
+                StatementCache &operator=(const StatementCache &other) = delete;
 
                 // 3. Move Constructor
-                // Allowed
+                // Not allowed, it's shared with the connection's statements
 
                 // 4. Move Assignment
-                // Allowed
+                // Not allowed
 
                 // 5. Destructor
                 // Implemented
                 // =========================================================================
 
-                UInt32 columnCount() {
-                    return _columnCount;
+                // Returns the cached handle, which the caller now owns, or nullptr on a miss. The query metadata
+                // described by previous executions, if any, comes along with it, and so do the parameters bound. The
+                // fetch array size a previous user may have set is not: it's back to the driver's default.
+                dpiStmt *take(const string &sql, MetadataSlot &metadata, BoundParams &binds) {
+                    auto it = _index.find(sql);
+                    if (it == _index.end()) {
+                        _misses++;
+                        return nullptr;
+                    }
+
+                    Entry &entry = *it->second;
+                    dpiStmt *stmt = entry.stmt;
+                    if (dpiStmt_setFetchArraySize(stmt, DPI_DEFAULT_FETCH_ARRAY_SIZE) == DPI_FAILURE) {
+                        _misses++;
+                        release(stmt);
+                        stmt = nullptr;
+                    } else {
+                        _hits++;
+                        metadata = std::move(entry.metadata);
+                        binds = std::move(entry.binds);
+                    }
+                    _entries.erase(it->second);
+                    _index.erase(it);
+                    return stmt;
+                }
+
+                // Takes ownership of the handle.
+                void put(const string &sql, dpiStmt *stmt, MetadataSlot metadata, BoundParams binds) {
+                    if (_capacity == 0 || _index.count(sql) > 0) {
+                        release(stmt);
+                        return;
+                    }
+
+                    _entries.push_front({sql, stmt, std::move(metadata), std::move(binds)});
+                    _index[sql] = _entries.begin();
+                    trim();
+                }
+
+                Bool evict(const string &sql) {
+                    auto it = _index.find(sql);
+                    if (it == _index.end()) {
+                        return False;
+                    }
+
+                    release(it->second->stmt);
+                    _entries.erase(it->second);
+                    _index.erase(it);
+                    return True;
+                }
+
+                void clear() {
+                    for (Entry &entry: _entries) {
+                        release(entry.stmt);
+                    }
+                    _entries.clear();
+                    _index.clear();
+                }
+
+                UInt32 capacity() {
+                    return _capacity;
+                }
+
+                void setCapacity(UInt32 capacity) {
+                    _capacity = capacity;
+                    trim();
+                }
+
+                UInt32 size() {
+                    return (UInt32) _entries.size();
+                }
+
+                UInt64 hits() {
+                    return _hits;
+                }
+
+                UInt64 misses() {
+                    return _misses;
                 }
 
-                Bool next() {
+                virtual ~StatementCache() {
+                    clear();
+                }
+            };
 
-                    int found; //boolean
-                    uint32_t bufferRowIndex; //not used
-                    if (dpiStmt_fetch(_stmt, &found, &bufferRowIndex) < 0) {
-                        DBException ex = DBException::build(_ctx);
-                        throw ex;
-                    }
+            class DBStatement {
+            private:
 
-                    if (found == 0) {
-                        _found = False;
+                dpiContext *_ctx = nullptr; //not owned
+                dpiConn *_conn = nullptr; //not owned
+                dpiStmt *_stmt = nullptr;
+                std::weak_ptr<StatementCache> _cache; //where _stmt goes back to, if the connection is still there
+                BoundParams _binds; //by this statement
+                BoundParams _inherited; //left on a cached handle by its previous users, until checked
+                string _sql; //only kept when cached, or for metrics
+                string _tag;
+                MetadataSlot _metadata; //created by the first execQuery
+                std::vector<std::unique_ptr<DBVar>> _vars; //array binds
+
+                DBMetrics *_registry = nullptr; //not owned, null when metrics are off
+                StatementMetrics *_metrics = nullptr; //not owned, resolved by metrics()
+                UInt64 _prepareNanos = 0;
+
+                SlowQueryLog *_slowLog = nullptr; //not owned, null when the slow query log is off
+                SlowQueryTrace _trace;
+                Bool _sampled{False}; //whether the next execution was sampled already
+                Bool _traced{False}; //whether the next execution is watched, once sampled
+
+                // Samples the next execution on its first bind, or when it runs. The binds are only captured while
+                // watching, so when it starts, the ones captured before may be stale and are dropped.
+                Bool watching() {
+                    if (_slowLog == nullptr) {
                         return False;
                     }
 
-                    _found = True;
-                    return True;
+                    if (_sampled == False) {
+                        Bool watch = _slowLog->sample();
+                        if (watch == True && _traced == False) {
+                            _trace.binds.clear();
+                        }
+                        _traced = watch;
+                        _sampled = True;
+                    }
+                    return _traced;
                 }
 
+                void traceBind(string name, dpiNativeTypeNum nativeTypeNum, const dpiData &data) {
+                    _slowLog->bind(_trace, std::move(name), nativeTypeNum, data);
+                }
 
-                string getString(unsigned int col) {
-                    fetchCol(col);
-                    return dataToString();
+                void traceBind(string name, DBVar &dbVar) {
+                    _slowLog->bind(_trace, std::move(name), "<array of " + std::to_string(dbVar.maxRows()) + ">");
                 }
 
-                optional<string> getStringOpt(unsigned int col) {
-                    fetchCol(col);
-                    if (dpiData_getIsNull(_data) == 1) {
-                        return std::nullopt;
-                    }
-                    return dataToString();
+                static string bindName(unsigned int col) {
+                    return ":" + std::to_string(col);
                 }
 
-                Int64 getInt64(unsigned int col) {
-                    fetchCol(col);
-                    return dataToInt64();
+                static string bindName(const char *param) {
+                    return param[0] == ':' ? string{param} : ":" + string{param};
                 }
 
-                Int64 getUInt64(unsigned int col) {
-                    fetchCol(col);
-                    return dataToUInt64();
+                // Hands the execution just made to the slow query log.
+                void traced(UInt64 executeNanos) {
+                    _trace.executeNanos = executeNanos;
+                    _trace.rows = getRowCount();
+                    _slowLog->finish(_trace);
                 }
 
-                Int32 getInt32(unsigned int col) {
-                    Int64 val = getInt64(col);
-                    if (val > std::numeric_limits<Int32>::max() ||
-                        val < std::numeric_limits<Int32>::lowest()) {
-                        throw Exception(sfput("The value for colum ${}, is outside of the Int32 limits.", col));
+                static dpiExecMode execManyMode(Bool batchErrors, Bool rowCounts) {
+                    dpiExecMode mode = DPI_MODE_EXEC_DEFAULT;
+                    if (batchErrors == True) {
+                        mode |= DPI_MODE_EXEC_BATCH_ERRORS;
+                    }
+                    if (rowCounts == True) {
+                        mode |= DPI_MODE_EXEC_ARRAY_DML_ROWCOUNTS;
                     }
-                    return (Int32) val;
+                    return mode;
                 }
 
-                Date getDate(unsigned int col) {
-                    fetchCol(col);
-                    dpiTimestamp timestamp = dataToTimestamp();
+                // A handle from the cache must not run with a value bound by a previous user, see BoundParams.
+                void checkBinds() {
+                    if (_inherited.empty() == True) {
+                        return;
+                    }
 
-                    return Date(toTimeGMT(timestamp));
+                    string param = _binds.missing(_inherited);
+                    if (param.empty() == false) {
+                        throw DBException(sfput("Parameter {} is not bound. The cached statement still holds the value "
+                                                "a previous user bound to it. Bind every parameter, the same way "
+                                                "(by position or by name), or use uncachedStatement().", param));
+                    }
+                    _inherited.clear();
                 }
 
+                // Runs the statement once, or numIters times when positive, and reports it to the metrics and the slow
+                // query log. Returns False when it fails, with the error left for DBException::build or DBError::last.
+                Bool execute(dpiExecMode mode, UInt32 numIters) {
+                    checkBinds();
+                    Bool watched = watching();
+                    _sampled = False;
+                    UInt64 start = _registry || watched == True ? monotonicNanos() : 0;
+                    int res = numIters > 0 ? dpiStmt_executeMany(_stmt, mode, numIters)
+                                           : dpiStmt_execute(_stmt, mode, NULL);
+                    if (res == DPI_FAILURE) {
+                        return False;
+                    }
 
-                DateTime getDateTime(unsigned int col) {
-                    fetchCol(col);
-                    dpiTimestamp timestamp = dataToTimestamp();
+                    if (_registry || watched == True) {
+                        UInt64 elapsed = monotonicNanos() - start;
+                        if (_registry) {
+                            metrics()->execute.record(elapsed);
+                        }
+                        if (watched == True) {
+                            traced(elapsed);
+                        }
+                    }
+                    return True;
+                }
+
+                // Resolved on first use, rather than in the constructor, so a tag set right after still applies.
+                StatementMetrics *metrics() {
+                    if (_metrics == nullptr && _registry) {
+                        _metrics = &_registry->statement(_tag.empty() ? _sql : _tag);
+                        _metrics->prepare.record(_prepareNanos);
+                    }
+                    return _metrics;
+                }
 
-                    tm t2 = toTimeGMT(timestamp);
-                    UInt16 millis = (UInt16)(timestamp.fsecond / 1'000'000.0);
+                void countBind() {
+                    if (_registry) {
+                        metrics()->binds.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
 
-                    Date date{t2};
-                    Time time{t2, millis};
 
-                    return DateTime(date, time);
+                DBVar &newVar(dpiOracleTypeNum oracleTypeNum, dpiNativeTypeNum nativeTypeNum, UInt32 maxRows,
+                              UInt32 size) {
+                    _vars.push_back(std::make_unique<DBVar>(_ctx, _conn, oracleTypeNum, nativeTypeNum, maxRows, size));
+                    return *_vars.back();
                 }
 
-                void forEach(std::function<void(ResultSet &)> f) {
-                    while (next() == True) {
-                        f(*this);
+                DBVar &bindVar(unsigned int col, DBVar &dbVar) {
+                    checkParamIsPositive("col", col);
+
+                    if (dpiStmt_bindByPos(_stmt, col, dbVar.handle()) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _binds.add(col);
+                    countBind();
+                    if (watching() == True) {
+                        traceBind(bindName(col), dbVar);
                     }
+                    return dbVar;
                 }
-            };
-
-            class DBStatement {
-            private:
 
-                dpiContext *_ctx = nullptr; //not owned
-                dpiConn *_conn = nullptr; //not owned
-                dpiStmt *_stmt = nullptr;
+                DBVar &bindVar(const char *param, DBVar &dbVar) {
+                    size_t len = strlen(param);
+                    if (dpiStmt_bindByName(_stmt, param, len, dbVar.handle()) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _binds.add(param);
+                    countBind();
+                    if (watching() == True) {
+                        traceBind(bindName(param), dbVar);
+                    }
+                    return dbVar;
+                }
 
 
                 void bindByPos(unsigned int col, dpiNativeTypeNum nativeTypeNum, dpiData &data) {
                     if (dpiStmt_bindValueByPos(_stmt, col, nativeTypeNum, &data) == DPI_FAILURE) {
                         throw DBException::build(_ctx);
                     }
+                    _binds.add(col);
+                    countBind();
+                    if (watching() == True) {
+                        traceBind(bindName(col), nativeTypeNum, data);
+                    }
                 }
 
                 void bindByName(const char *param, dpiNativeTypeNum nativeTypeNum, dpiData &data) {
@@ -346,15 +3284,106 @@ namespace ylib {
                     if (dpiStmt_bindValueByName(_stmt, param, len, nativeTypeNum, &data) == DPI_FAILURE) {
                         throw DBException::build(_ctx);
                     }
+                    _binds.add(param);
+                    countBind();
+                    if (watching() == True) {
+                        traceBind(bindName(param), nativeTypeNum, data);
+                    }
+                }
+
+                // One overload per field type of a RecordMapping.
+                // =========================================================================
+                void setField(const char *param, Int64 val) {
+                    setInt64(param, val);
+                }
+
+                void setField(const char *param, Int32 val) {
+                    setInt64(param, val);
+                }
+
+                void setField(const char *param, UInt64 val) {
+                    setUInt64(param, val);
+                }
+
+                void setField(const char *param, double val) {
+                    setDouble(param, val);
+                }
+
+                void setField(const char *param, const string &val) {
+                    setString(param, val);
+                }
+
+                void setField(const char *param, const Date &val) {
+                    setDate(param, val);
+                }
+
+                void setField(const char *param, const DateTime &val) {
+                    setDateTime(param, val);
+                }
+
+                template<typename T>
+                void setField(const char *param, const optional<T> &val) {
+                    if (val.has_value()) {
+                        setField(param, val.value());
+                    } else {
+                        setNull(param, ColumnDecoder<T>::nativeTypeNum);
+                    }
                 }
+                // =========================================================================
 
             public:
-                DBStatement(dpiContext *ctx, dpiConn *conn, const char *sql) {
+                DBStatement(dpiContext *ctx, dpiConn *conn, const char *sql, DBMetrics *metrics = nullptr,
+                            SlowQueryLog *slowLog = nullptr) {
                     _ctx = ctx;
                     _conn = conn;
+                    _registry = metrics;
+                    _slowLog = slowLog;
+
+                    UInt64 start = _registry ? monotonicNanos() : 0;
                     if (dpiConn_prepareStmt(_conn, 0, sql, strlen(sql), NULL, 0, &_stmt) == DPI_FAILURE) {
                         throw DBException::build(_ctx);
                     }
+
+                    if (_registry) {
+                        _prepareNanos = monotonicNanos() - start;
+                    }
+                    if (_registry || _slowLog) {
+                        _sql = sql;
+                    }
+                    if (_slowLog) {
+                        _trace.log = _slowLog;
+                        _trace.sql = _sql;
+                    }
+                }
+
+                DBStatement(dpiContext *ctx, dpiConn *conn, const char *sql, const std::shared_ptr<StatementCache> &cache,
+                            DBMetrics *metrics = nullptr, SlowQueryLog *slowLog = nullptr) {
+                    _ctx = ctx;
+                    _conn = conn;
+                    _registry = metrics;
+                    _slowLog = slowLog;
+
+                    UInt64 start = _registry ? monotonicNanos() : 0;
+                    if (cache->capacity() > 0 || _registry || _slowLog) {
+                        _sql = sql;
+                    }
+                    if (cache->capacity() > 0) {
+                        _cache = cache;
+                        _stmt = cache->take(_sql, _metadata, _inherited);
+                    }
+
+                    if (_stmt == nullptr &&
+                        dpiConn_prepareStmt(_conn, 0, sql, strlen(sql), NULL, 0, &_stmt) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    if (_registry) {
+                        _prepareNanos = monotonicNanos() - start;
+                    }
+                    if (_slowLog) {
+                        _trace.log = _slowLog;
+                        _trace.sql = _sql;
+                    }
                 }
 
                 // Rule of five
@@ -368,15 +3397,34 @@ namespace ylib {
                 DBStatement &operator=(const DBStatement &other) = delete;
 
                 // 3. Move Constructor
-                // Allowed
+                // Not allowed
 
                 // 4. Move Assignment
-                // Allowed
+                // Not allowed
 
                 // 5. Destructor
                 // Implemented
                 // =========================================================================
 
+                // Binds a value as the driver holds it, e.g. one read with ResultSet::getData. Bytes are copied.
+                void setData(unsigned int col, dpiNativeTypeNum nativeTypeNum, const dpiData &data) {
+                    dpiData copy = data;
+                    bindByPos(col, nativeTypeNum, copy);
+                }
+
+                void setData(const char *param, dpiNativeTypeNum nativeTypeNum, const dpiData &data) {
+                    dpiData copy = data;
+                    bindByName(param, nativeTypeNum, copy);
+                }
+
+                // Binds every field of record by name, see RecordMapping.
+                template<typename S>
+                void setRecord(const S &record) {
+                    std::apply([&](auto &... field) {
+                        (setField(field.name, record.*(field.member)), ...);
+                    }, RecordMapping<S>::fields);
+                }
+
                 void setNull(unsigned int col, dpiNativeTypeNum typeNum) {
                     checkParamIsPositive("col", col);
 
@@ -529,76 +3577,318 @@ namespace ylib {
                     bindByPos(col, DPI_NATIVE_TYPE_BOOLEAN, data);
                 }
 
-                void setDateTime(const char *param, const core::DateTime val) {
-                    dpiData data;
-                    Date date = val.date();
-                    Time time = val.time();
-                    Int32 fractions = time.milli();
-                    fractions = fractions * ((Int32) 1000000);
-                    dpiData_setTimestamp(&data, date.year(),
-                                         monthToUInt(date.month()),
-                                         date.day(),
-                                         time.hour(),
-                                         time.min(),
-                                         time.sec(),
-                                         fractions,
-                                         0, 0);
-                    bindByName(param, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                void setDateTime(const char *param, const core::DateTime val) {
+                    dpiData data;
+                    Date date = val.date();
+                    Time time = val.time();
+                    Int32 fractions = time.milli();
+                    fractions = fractions * ((Int32) 1000000);
+                    dpiData_setTimestamp(&data, date.year(),
+                                         monthToUInt(date.month()),
+                                         date.day(),
+                                         time.hour(),
+                                         time.min(),
+                                         time.sec(),
+                                         fractions,
+                                         0, 0);
+                    bindByName(param, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                }
+
+                void setDateTime(unsigned int col, const core::DateTime val) {
+                    dpiData data;
+                    Date date = val.date();
+                    Time time = val.time();
+                    Int32 fractions = time.milli();
+                    fractions = fractions * ((Int32) 1000000);
+                    dpiData_setTimestamp(&data, date.year(),
+                                         monthToUInt(date.month()),
+                                         date.day(),
+                                         time.hour(),
+                                         time.min(),
+                                         time.sec(),
+                                         fractions,
+                                         0, 0);
+                    bindByPos(col, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                }
+
+                void setDateTimeOpt(const char *param, const optional<core::DateTime> val) {
+                    if (val.has_value()) {
+                        setDateTime(param, val.value());
+                    } else {
+                        setNull(param, DPI_NATIVE_TYPE_TIMESTAMP);
+                    }
+                }
+
+                void setDateTimeOpt(unsigned int col, const optional<core::DateTime> val) {
+                    if (val.has_value()) {
+                        setDateTime(col, val.value());
+                    } else {
+                        setNull(col, DPI_NATIVE_TYPE_TIMESTAMP);
+                    }
+                }
+
+                void setDate(const char *param, const core::Date date) {
+                    dpiData data;
+
+                    dpiData_setTimestamp(&data, date.year(),
+                                         monthToUInt(date.month()),
+                                         date.day(),
+                                         0,
+                                         0,
+                                         0,
+                                         0,
+                                         0, 0);
+                    bindByName(param, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                }
+
+                // The LOB must be closed (its buffered writes flushed) before the statement is executed.
+                void setLob(unsigned int col, LobStream &lob) {
+                    checkParamIsPositive("col", col);
+
+                    dpiData data;
+                    dpiData_setLOB(&data, lob.handle());
+
+                    bindByPos(col, DPI_NATIVE_TYPE_LOB, data);
+                }
+
+                void setLob(const char *param, LobStream &lob) {
+
+                    dpiData data;
+                    dpiData_setLOB(&data, lob.handle());
+
+                    bindByName(param, DPI_NATIVE_TYPE_LOB, data);
+                }
+
+                /*
+                 * Metrics of this statement are kept under tag instead of its SQL text, and the slow query log shows it
+                 * next to it. Must be called before it's bound or executed.
+                 */
+                void setTag(const string &tag) {
+                    if (_metrics) {
+                        throw DBException("The tag of a statement must be set before it's bound or executed.");
+                    }
+                    _tag = tag;
+                    _trace.tag = tag;
+                }
+
+                const string &tag() {
+                    return _tag;
+                }
+
+                void exec() {
+                    if (execute(DPI_MODE_EXEC_DEFAULT, 0) == False) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                // Parses the statement on the server without executing it, so errors in the SQL show up now. The
+                // parsed cursor then stays in the session's statement cache, see warmUp().
+                void parse() {
+                    if (dpiStmt_execute(_stmt, DPI_MODE_EXEC_PARSE_ONLY, NULL) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                // Same as exec(), but a failure is returned instead of thrown. A parameter left unbound on a cached
+                // statement is misuse, not a failure: it still throws.
+                DBResult<> tryExec() {
+                    if (execute(DPI_MODE_EXEC_DEFAULT, 0) == False) {
+                        return DBError::last(_ctx);
+                    }
+                    return {};
+                }
+
+                // Executes and commits the transaction in the same round trip, instead of a separate commit(). Nothing
+                // is committed when it fails.
+                void execAndCommit() {
+                    if (execute(DPI_MODE_EXEC_COMMIT_ON_SUCCESS, 0) == False) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                // Same as execAndCommit(), and like tryExec() it still throws for a parameter left unbound.
+                DBResult<> tryExecAndCommit() {
+                    if (execute(DPI_MODE_EXEC_COMMIT_ON_SUCCESS, 0) == False) {
+                        return DBError::last(_ctx);
+                    }
+                    return {};
+                }
+
+
+                // Array DML
+                // =========================================================================
+                // Each bindArray* call binds a DBVar holding up to maxRows values to a placeholder. Fill the rows
+                // through the returned DBVar, then run all of them in a single round trip with execMany. The variables
+                // live as long as the statement, so bind them once and refill them for every batch.
+
+                DBVar &bindArrayInt64(unsigned int col, UInt32 maxRows) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_INT64, maxRows, 0));
+                }
+
+                DBVar &bindArrayInt64(const char *param, UInt32 maxRows) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_INT64, maxRows, 0));
+                }
+
+                DBVar &bindArrayUInt64(unsigned int col, UInt32 maxRows) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_UINT64, maxRows, 0));
+                }
+
+                DBVar &bindArrayUInt64(const char *param, UInt32 maxRows) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_UINT64, maxRows, 0));
+                }
+
+                DBVar &bindArrayDouble(unsigned int col, UInt32 maxRows) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_DOUBLE, maxRows, 0));
+                }
+
+                DBVar &bindArrayDouble(const char *param, UInt32 maxRows) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_DOUBLE, maxRows, 0));
+                }
+
+                // maxLength is the size, in bytes, of the longest value that will be set.
+                DBVar &bindArrayString(unsigned int col, UInt32 maxRows, UInt32 maxLength) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_VARCHAR, DPI_NATIVE_TYPE_BYTES, maxRows, maxLength));
+                }
+
+                DBVar &bindArrayString(const char *param, UInt32 maxRows, UInt32 maxLength) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_VARCHAR, DPI_NATIVE_TYPE_BYTES, maxRows, maxLength));
+                }
+
+                DBVar &bindArrayDateTime(unsigned int col, UInt32 maxRows) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_TIMESTAMP, DPI_NATIVE_TYPE_TIMESTAMP, maxRows, 0));
+                }
+
+                DBVar &bindArrayDateTime(const char *param, UInt32 maxRows) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_TIMESTAMP, DPI_NATIVE_TYPE_TIMESTAMP, maxRows, 0));
+                }
+
+                // OUT binds, also used for RETURNING INTO. maxRows must cover the rows of the execMany they're used
+                // with; for a single exec, the default of 1 is enough.
+
+                DBVar &bindOutInt64(unsigned int col, UInt32 maxRows = 1) {
+                    return bindArrayInt64(col, maxRows);
+                }
+
+                DBVar &bindOutInt64(const char *param, UInt32 maxRows = 1) {
+                    return bindArrayInt64(param, maxRows);
+                }
+
+                DBVar &bindOutUInt64(unsigned int col, UInt32 maxRows = 1) {
+                    return bindArrayUInt64(col, maxRows);
+                }
+
+                DBVar &bindOutUInt64(const char *param, UInt32 maxRows = 1) {
+                    return bindArrayUInt64(param, maxRows);
+                }
+
+                DBVar &bindOutDouble(unsigned int col, UInt32 maxRows = 1) {
+                    return bindArrayDouble(col, maxRows);
+                }
+
+                DBVar &bindOutDouble(const char *param, UInt32 maxRows = 1) {
+                    return bindArrayDouble(param, maxRows);
+                }
+
+                DBVar &bindOutString(unsigned int col, UInt32 maxLength, UInt32 maxRows = 1) {
+                    return bindArrayString(col, maxRows, maxLength);
+                }
+
+                DBVar &bindOutString(const char *param, UInt32 maxLength, UInt32 maxRows = 1) {
+                    return bindArrayString(param, maxRows, maxLength);
+                }
+
+                DBVar &bindOutDateTime(unsigned int col, UInt32 maxRows = 1) {
+                    return bindArrayDateTime(col, maxRows);
+                }
+
+                DBVar &bindOutDateTime(const char *param, UInt32 maxRows = 1) {
+                    return bindArrayDateTime(param, maxRows);
+                }
+
+                // An OUT SYS_REFCURSOR, read it after the execution with DBVar::getCursor.
+
+                DBVar &bindCursor(unsigned int col) {
+                    return bindVar(col, newVar(DPI_ORACLE_TYPE_STMT, DPI_NATIVE_TYPE_STMT, 1, 0));
                 }
 
-                void setDateTime(unsigned int col, const core::DateTime val) {
-                    dpiData data;
-                    Date date = val.date();
-                    Time time = val.time();
-                    Int32 fractions = time.milli();
-                    fractions = fractions * ((Int32) 1000000);
-                    dpiData_setTimestamp(&data, date.year(),
-                                         monthToUInt(date.month()),
-                                         date.day(),
-                                         time.hour(),
-                                         time.min(),
-                                         time.sec(),
-                                         fractions,
-                                         0, 0);
-                    bindByPos(col, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                DBVar &bindCursor(const char *param) {
+                    return bindVar(param, newVar(DPI_ORACLE_TYPE_STMT, DPI_NATIVE_TYPE_STMT, 1, 0));
                 }
 
-                void setDateTimeOpt(const char *param, const optional<core::DateTime> val) {
-                    if (val.has_value()) {
-                        setDateTime(param, val.value());
-                    } else {
-                        setNull(param, DPI_NATIVE_TYPE_TIMESTAMP);
+                /*
+                 * Executes the statement once for each of the first numRows rows of the bound arrays, in a single round
+                 * trip.
+                 *
+                 * batchErrors: the rows that fail don't abort the batch; the rest are still executed and the failures
+                 * can be read with getBatchErrors(). Note that the statement itself doesn't fail in that case.
+                 * rowCounts: keeps the number of rows affected by each row of the batch, see getRowCounts().
+                 */
+                void execMany(UInt32 numRows, Bool batchErrors = False, Bool rowCounts = False) {
+                    checkParamIsPositive("numRows", numRows);
+
+                    if (execute(execManyMode(batchErrors, rowCounts), numRows) == False) {
+                        throw DBException::build(_ctx);
                     }
                 }
 
-                void setDateTimeOpt(unsigned int col, const optional<core::DateTime> val) {
-                    if (val.has_value()) {
-                        setDateTime(col, val.value());
-                    } else {
-                        setNull(col, DPI_NATIVE_TYPE_TIMESTAMP);
+                // Same as execMany(), but a failure is returned instead of thrown. Like tryExec(), misuse still
+                // throws: numRows 0, or a parameter left unbound.
+                DBResult<> tryExecMany(UInt32 numRows, Bool batchErrors = False, Bool rowCounts = False) {
+                    checkParamIsPositive("numRows", numRows);
+
+                    if (execute(execManyMode(batchErrors, rowCounts), numRows) == False) {
+                        return DBError::last(_ctx);
                     }
+                    return {};
                 }
 
-                void setDate(const char *param, const core::Date date) {
-                    dpiData data;
+                // execMany and commit in the same round trip. With batchErrors, the rows that didn't fail are
+                // committed too.
+                void execManyAndCommit(UInt32 numRows, Bool batchErrors = False, Bool rowCounts = False) {
+                    checkParamIsPositive("numRows", numRows);
 
-                    dpiData_setTimestamp(&data, date.year(),
-                                         monthToUInt(date.month()),
-                                         date.day(),
-                                         0,
-                                         0,
-                                         0,
-                                         0,
-                                         0, 0);
-                    bindByName(param, DPI_NATIVE_TYPE_TIMESTAMP, data);
+                    dpiExecMode mode = execManyMode(batchErrors, rowCounts) | DPI_MODE_EXEC_COMMIT_ON_SUCCESS;
+                    if (execute(mode, numRows) == False) {
+                        throw DBException::build(_ctx);
+                    }
                 }
 
-                void exec() {
-                    if (dpiStmt_execute(_stmt, DPI_MODE_EXEC_DEFAULT, NULL) == DPI_FAILURE) {
+                // The rows affected by each row of the last execMany. Only available when it ran with rowCounts.
+                std::vector<UInt64> getRowCounts() {
+                    uint32_t numRowCounts;
+                    uint64_t *rowCounts; //not owned
+
+                    if (dpiStmt_getRowCounts(_stmt, &numRowCounts, &rowCounts) == DPI_FAILURE) {
                         throw DBException::build(_ctx);
                     }
+
+                    return std::vector<UInt64>(rowCounts, rowCounts + numRowCounts);
                 }
 
+                // The rows that failed in the last execMany. Only available when it ran with batchErrors.
+                std::vector<BatchError> getBatchErrors() {
+                    uint32_t count;
+                    if (dpiStmt_getBatchErrorCount(_stmt, &count) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    std::vector<BatchError> ans;
+                    if (count == 0) {
+                        return ans;
+                    }
+
+                    std::vector<dpiErrorInfo> errors(count);
+                    if (dpiStmt_getBatchErrors(_stmt, count, errors.data()) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    ans.reserve(count);
+                    for (dpiErrorInfo &err: errors) {
+                        ans.push_back({err.offset + 1, err.code, string{err.message, err.messageLength}});
+                    }
+                    return ans;
+                }
+                // =========================================================================
 
                 UInt64 getRowCount() {
                     uint64_t count;
@@ -615,8 +3905,64 @@ namespace ylib {
                     return count;
                 }
 
+                /*
+                 * Number of rows the driver fetches per round trip, for the queries executed after this call. The
+                 * ODPI default is 100 (DPI_DEFAULT_FETCH_ARRAY_SIZE). It also caps how many rows a single
+                 * ResultSet::nextBatch call can return. Only this statement gets it: a handle back from the
+                 * StatementCache starts over with the default.
+                 */
+                void setFetchArraySize(UInt32 size) {
+                    checkParamIsPositive("size", size);
+
+                    if (dpiStmt_setFetchArraySize(_stmt, size) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                UInt32 getFetchArraySize() {
+                    uint32_t size;
+                    if (dpiStmt_getFetchArraySize(_stmt, &size) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return size;
+                }
+
+                // When the slow query log watches this execution, the ResultSet takes a copy of its trace, SQL text and
+                // binds included, and hands it over once destroyed.
                 ResultSet execQuery() {
-                    return {_ctx, _stmt};
+                    checkBinds();
+                    SlowQueryTrace *trace = watching() == True ? &_trace : nullptr;
+                    _sampled = False;
+                    if (_metadata == nullptr) {
+                        _metadata = std::make_shared<std::shared_ptr<QueryMetadata>>();
+                    }
+                    return {_ctx, _conn, _stmt, _metadata, metrics(), trace};
+                }
+
+                /*
+                 * The next result a PL/SQL block returned with DBMS_SQL.RETURN_RESULT, in order, or none once they are
+                 * all read. Each one can set its own fetch array size (ResultSet::setFetchArraySize).
+                 */
+                std::optional<ResultSet> nextImplicitResult() {
+                    dpiStmt *result;
+                    if (dpiStmt_getImplicitResult(_stmt, &result) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    if (result == nullptr) {
+                        return std::nullopt;
+                    }
+                    return std::optional<ResultSet>{std::in_place, _ctx, _conn, result, Executed{}};
+                }
+
+                void forEachImplicitResult(std::function<void(ResultSet &)> f) {
+                    while (true) {
+                        std::optional<ResultSet> rs = nextImplicitResult();
+                        if (rs.has_value() == false) {
+                            return;
+                        }
+                        f(*rs);
+                    }
                 }
 
                 UInt64 execCount() {
@@ -656,7 +4002,13 @@ namespace ylib {
 
                 virtual ~DBStatement() {
                     try {
-                        if (_stmt) {
+                        // The cache is gone with the connection when the statement outlives it. The driver keeps the
+                        // handle valid until it's released, so it's then released directly.
+                        std::shared_ptr<StatementCache> cache = _cache.lock();
+                        if (_stmt && cache) {
+                            _binds.merge(_inherited);
+                            cache->put(_sql, _stmt, std::move(_metadata), std::move(_binds));
+                        } else if (_stmt) {
                             dpiStmt_release(_stmt);
                         }
                     } catch (std::exception &ex) {
@@ -669,6 +4021,10 @@ namespace ylib {
             private:
                 dpiContext *_ctx = nullptr; //not owned
                 dpiConn *_conn = nullptr;
+                // Shared with the statements, so one destroyed after the connection can tell the cache is gone.
+                std::shared_ptr<StatementCache> _cache = std::make_shared<StatementCache>(DPI_DEFAULT_STMT_CACHE_SIZE);
+                DBMetrics *_metrics = nullptr; //not owned
+                SlowQueryLog *_slowLog = nullptr; //not owned
 
             public:
 
@@ -694,6 +4050,16 @@ namespace ylib {
 
                 }
 
+                // Takes ownership of an already created connection, e.g. one acquired from a DBPool. Releasing a
+                // pooled connection hands it back to its pool.
+                DBConnection(dpiContext *ctx, dpiConn *conn, DBMetrics *metrics = nullptr,
+                             SlowQueryLog *slowLog = nullptr) {
+                    _ctx = ctx;
+                    _conn = conn;
+                    _metrics = metrics;
+                    _slowLog = slowLog;
+                }
+
                 // Rule of five
                 // =========================================================================
                 // 1. Copy Constructor
@@ -705,29 +4071,91 @@ namespace ylib {
                 DBConnection &operator=(const DBConnection &other) = delete;
 
                 // 3. Move Constructor
-                // Allowed
+                // Not allowed
 
                 // 4. Move Assignment
-                // Allowed
+                // Not allowed
 
                 // 5. Destructor
                 // Implemented
                 // =========================================================================
 
+                // The handle comes from the statement cache when the same SQL was prepared before on this connection.
                 DBStatement statement(const char *sql) {
-                    return {_ctx, _conn, sql};
+                    return {_ctx, _conn, sql, _cache, _metrics, _slowLog};
                 }
 
                 DBStatement statement(string sql) {
-                    return {_ctx, _conn, sql.c_str()};
+                    return {_ctx, _conn, sql.c_str(), _cache, _metrics, _slowLog};
+                }
+
+                // Always prepares a new handle, bypassing the statement cache.
+                DBStatement uncachedStatement(const char *sql) {
+                    return {_ctx, _conn, sql, _metrics, _slowLog};
+                }
+
+                // A temporary LOB to write to, and then bind with DBStatement::setLob. type is DPI_ORACLE_TYPE_CLOB,
+                // DPI_ORACLE_TYPE_NCLOB or DPI_ORACLE_TYPE_BLOB.
+                LobStream newTempLob(dpiOracleTypeNum type, UInt32 chunksPerCall = 16) {
+                    dpiLob *lob;
+                    if (dpiConn_newTempLob(_conn, type, &lob) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return {_ctx, lob, False, chunksPerCall};
+                }
+
+                StatementCache &statementCache() {
+                    return *_cache;
+                }
+
+                // Resizes both the wrapper's LRU and the driver's statement cache. Zero disables them.
+                void setStatementCacheSize(UInt32 size) {
+                    if (dpiConn_setStmtCacheSize(_conn, size) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    _cache->setCapacity(size);
+                }
+
+
+                // Statements created afterwards report to metrics, which must outlive them. Null turns metrics off.
+                void setMetrics(DBMetrics *metrics) {
+                    _metrics = metrics;
                 }
 
+                DBMetrics *metrics() {
+                    return _metrics;
+                }
+
+                // Statements created afterwards report to slowLog, which must outlive them. Null turns it off.
+                void setSlowQueryLog(SlowQueryLog *slowLog) {
+                    _slowLog = slowLog;
+                }
+
+                SlowQueryLog *slowQueryLog() {
+                    return _slowLog;
+                }
 
                 void commit() {
                     // commit changes
+                    UInt64 start = _metrics ? monotonicNanos() : 0;
                     if (dpiConn_commit(_conn) == DPI_FAILURE) {
                         throw DBException::build(_ctx);
                     }
+                    if (_metrics) {
+                        _metrics->commit().record(monotonicNanos() - start);
+                    }
+                }
+
+                // Same as commit(), but a failure is returned instead of thrown.
+                DBResult<> tryCommit() {
+                    UInt64 start = _metrics ? monotonicNanos() : 0;
+                    if (dpiConn_commit(_conn) == DPI_FAILURE) {
+                        return DBError::last(_ctx);
+                    }
+                    if (_metrics) {
+                        _metrics->commit().record(monotonicNanos() - start);
+                    }
+                    return {};
                 }
 
                 void rollack() {
@@ -737,6 +4165,13 @@ namespace ylib {
                     }
                 }
 
+                DBResult<> tryRollback() {
+                    if (dpiConn_rollback(_conn) == DPI_FAILURE) {
+                        return DBError::last(_ctx);
+                    }
+                    return {};
+                }
+
 
                 template<typename F>
                 auto transaction(F f) {
@@ -752,6 +4187,8 @@ namespace ylib {
                 }
 
                 virtual ~DBConnection() {
+                    _cache->clear();
+
                     try {
                         if (_conn) {
                             dpiConn_release(_conn);
@@ -763,6 +4200,290 @@ namespace ylib {
             };
 
 
+            /*
+             * Commits every maxStatements executions or every maxMillis, whichever comes first, for workers that write
+             * in small transactions. The execution that reaches either limit commits in its own round trip
+             * (execAndCommit), so a commit never costs one more.
+             *
+             * The time limit is checked on each call, there is no timer thread: a worker that may go idle with pending
+             * work calls poll() or flush(). Pending work is committed when the GroupCommit is destroyed, or rolled back
+             * if that's because of an exception.
+             */
+            class GroupCommit {
+            private:
+                DBConnection &_conn; //not owned
+                UInt32 _maxStatements;
+                UInt64 _maxNanos;
+                UInt32 _pending = 0;
+                UInt64 _pendingSince = 0;
+                UInt64 _commits = 0;
+                int _uncaught; //exceptions in flight when constructed
+
+                Bool due(UInt64 now) {
+                    return _pending + 1 >= _maxStatements || (_pending > 0 && now - _pendingSince >= _maxNanos)
+                           ? True : False;
+                }
+
+                void executed(Bool committed, UInt64 now) {
+                    if (committed == True) {
+                        _pending = 0;
+                        _commits++;
+                    } else if (_pending++ == 0) {
+                        _pendingSince = now;
+                    }
+                }
+
+            public:
+                GroupCommit(DBConnection &conn, UInt32 maxStatements, UInt32 maxMillis) : _conn{conn} {
+                    checkParamIsPositive("maxStatements", maxStatements);
+
+                    _maxStatements = maxStatements;
+                    _maxNanos = (UInt64) maxMillis * 1'000'000;
+                    _uncaught = std::uncaught_exceptions();
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                GroupCommit(const GroupCommit &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                GroupCommit &operator=(const GroupCommit &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                // stm must belong to the connection given in the constructor.
+                void exec(DBStatement &stm) {
+                    UInt64 now = monotonicNanos();
+                    Bool commit = due(now);
+                    if (commit == True) {
+                        stm.execAndCommit();
+                    } else {
+                        stm.exec();
+                    }
+                    executed(commit, now);
+                }
+
+                // A whole batch counts as one execution.
+                void execMany(DBStatement &stm, UInt32 numRows, Bool batchErrors = False) {
+                    UInt64 now = monotonicNanos();
+                    Bool commit = due(now);
+                    if (commit == True) {
+                        stm.execManyAndCommit(numRows, batchErrors);
+                    } else {
+                        stm.execMany(numRows, batchErrors);
+                    }
+                    executed(commit, now);
+                }
+
+                // Commits if the pending work is older than maxMillis.
+                void poll() {
+                    if (_pending > 0 && monotonicNanos() - _pendingSince >= _maxNanos) {
+                        flush();
+                    }
+                }
+
+                // Commits the pending work now, if any.
+                void flush() {
+                    if (_pending > 0) {
+                        _conn.commit();
+                        _pending = 0;
+                        _commits++;
+                    }
+                }
+
+                // Executions not committed yet.
+                UInt32 pending() {
+                    return _pending;
+                }
+
+                UInt64 commits() {
+                    return _commits;
+                }
+
+                virtual ~GroupCommit() {
+                    try {
+                        if (std::uncaught_exceptions() > _uncaught) {
+                            if (_pending > 0) {
+                                _conn.rollack();
+                            }
+                        } else {
+                            flush();
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+            };
+
+
+            struct DBPoolConfig {
+                UInt32 minSessions = 1;
+                UInt32 maxSessions = 1;
+                UInt32 sessionIncrement = 0;
+                // Milliseconds acquire() waits for a free session when the pool is at maxSessions. Zero waits forever.
+                UInt32 waitTimeout = 0;
+            };
+
+            /*
+             * A session pool over dpiPool. acquire() can be called from many threads at once, and the DBConnection it
+             * returns goes back to the pool when destroyed. The pool must outlive its connections.
+             */
+            class DBPool {
+            private:
+                dpiContext *_ctx = nullptr; //not owned
+                dpiPool *_pool = nullptr;
+                UInt32 _maxSessions = 0;
+                std::atomic<DBMetrics *> _metrics{nullptr}; //not owned, read by acquire() on any thread
+                std::atomic<SlowQueryLog *> _slowLog{nullptr}; //not owned, read by acquire() on any thread
+
+            public:
+                DBPool(dpiContext *ctx,
+                       const string &user,
+                       const string &pass,
+                       const string &connStr,
+                       const DBPoolConfig &config) {
+                    checkParamIsPositive("maxSessions", config.maxSessions);
+
+                    if (config.minSessions > config.maxSessions) {
+                        throw DBException(sfput("The pool minSessions ({}) is greater than its maxSessions ({}).",
+                                                config.minSessions, config.maxSessions));
+                    }
+
+                    _ctx = ctx;
+                    _maxSessions = config.maxSessions;
+
+                    // Sessions are acquired and used from many threads, so OCI must guard its own structures. The
+                    // encodings stay the UTF-8 defaults.
+                    dpiCommonCreateParams common;
+                    if (dpiContext_initCommonCreateParams(_ctx, &common) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    common.createMode = (dpiCreateMode) (common.createMode | DPI_MODE_CREATE_THREADED);
+
+                    dpiPoolCreateParams params;
+                    if (dpiContext_initPoolCreateParams(_ctx, &params) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+
+                    params.minSessions = config.minSessions;
+                    params.maxSessions = config.maxSessions;
+                    params.sessionIncrement = config.sessionIncrement;
+                    if (config.waitTimeout > 0) {
+                        params.getMode = DPI_MODE_POOL_GET_TIMEDWAIT;
+                        params.waitTimeout = config.waitTimeout;
+                    } else {
+                        params.getMode = DPI_MODE_POOL_GET_WAIT;
+                    }
+
+                    if (dpiPool_create(
+                            _ctx,
+                            user.c_str(), user.length(),
+                            pass.c_str(), pass.length(),
+                            connStr.c_str(), connStr.length(),
+                            &common, &params, &_pool) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                DBPool(const DBPool &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                DBPool &operator=(const DBPool &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                // Blocks until a session is free, or throws once the pool's waitTimeout is over.
+                DBConnection acquire() {
+                    dpiConn *conn;
+                    if (dpiPool_acquireConnection(_pool, NULL, 0, NULL, 0, NULL, &conn) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return {_ctx, conn, _metrics.load(std::memory_order_acquire),
+                            _slowLog.load(std::memory_order_acquire)};
+                }
+
+                // Connections acquired afterwards report to metrics, see DBConnection::setMetrics. Safe while other
+                // threads acquire.
+                void setMetrics(DBMetrics *metrics) {
+                    _metrics.store(metrics, std::memory_order_release);
+                }
+
+                // Connections acquired afterwards report to slowLog, see DBConnection::setSlowQueryLog. Safe while other
+                // threads acquire.
+                void setSlowQueryLog(SlowQueryLog *slowLog) {
+                    _slowLog.store(slowLog, std::memory_order_release);
+                }
+
+                // Sessions currently acquired.
+                UInt32 busyCount() {
+                    uint32_t count;
+                    if (dpiPool_getBusyCount(_pool, &count) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return count;
+                }
+
+                // Sessions open, either busy or idle.
+                UInt32 openCount() {
+                    uint32_t count;
+                    if (dpiPool_getOpenCount(_pool, &count) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                    return count;
+                }
+
+                // As configured, see DBPoolConfig.
+                UInt32 maxSessions() {
+                    return _maxSessions;
+                }
+
+                // Only applies when the pool was created with a waitTimeout.
+                void setWaitTimeout(UInt32 millis) {
+                    if (dpiPool_setWaitTimeout(_pool, millis) == DPI_FAILURE) {
+                        throw DBException::build(_ctx);
+                    }
+                }
+
+                virtual ~DBPool() {
+                    try {
+                        if (_pool) {
+                            if (dpiPool_close(_pool, DPI_MODE_POOL_CLOSE_DEFAULT) == DPI_FAILURE) {
+                                DBException ex = DBException::build(_ctx);
+                                log.error(ex);
+                            }
+                            dpiPool_release(_pool);
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+            };
+
+
             class DBEnvironment {
             private:
                 dpiContext *_ctx = nullptr;
@@ -791,10 +4512,10 @@ namespace ylib {
                 DBEnvironment &operator=(const DBEnvironment &other) = delete;
 
                 // 3. Move Constructor
-                // Allowed
+                // Not allowed
 
                 // 4. Move Assignment
-                // Allowed
+                // Not allowed
 
                 // 5. Destructor
                 // Implemented
@@ -808,6 +4529,10 @@ namespace ylib {
                     return {_ctx, user, pass, connStr};
                 }
 
+                DBPool pool(const string &user, const string &pass, const string &connStr, const DBPoolConfig &config) {
+                    return {_ctx, user, pass, connStr, config};
+                }
+
                 virtual ~DBEnvironment() {
                     try {
                         if (_ctx) {
@@ -820,6 +4545,8 @@ namespace ylib {
             };
 
 
+            // Costs a second query, by ROWID. Prefer INSERT ... RETURNING col INTO :out, with DBStatement::bindOutInt64,
+            // which returns the key in the same round trip, and works with execMany too.
             UInt64 getLastInsertedPKInt64(DBConnection &conn, DBStatement &stmt, const char* table, const char* col) {
 
                 string rowId = stmt.getLastRowId(); //Oracle's ROWID value, not PK
@@ -0,0 +1,568 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <ylib/db/dpiw.h>
+#include <ylib/db/dpiw/io.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            // The type a field is converted to, and bound as.
+            enum class BulkType {
+                INT64, UINT64, DOUBLE, STRING, DATETIME
+            };
+
+            struct BulkColumn {
+                BulkType type;
+                UInt32 maxLength = 0; //STRING only, in bytes
+            };
+
+            struct BulkLoadOptions {
+                char delimiter = ',';
+                char quote = '"';
+                Bool header{False}; //skip the first line of the file
+                UInt32 batchRows = 1000; //rows per array DML execution
+                UInt64 commitInterval = 0; //rows per commit on each connection, 0 commits only at the end
+                UInt32 threads = 1; //parse threads, each one with its own connection (DBPool only)
+                size_t rejectBufferSize = 64 * 1024;
+                string rejectFile; //bad rows are copied here as is, and the reasons to <rejectFile>.log
+            };
+
+            struct BulkLoadResult {
+                UInt64 rows = 0; //records read, blank lines aside
+                UInt64 loaded = 0;
+                UInt64 rejected = 0;
+            };
+
+            /*
+             * Splits delimited records into fields. Quoted fields follow RFC 4180: the quote is escaped by doubling it,
+             * and the delimiter and line breaks lose their meaning inside. Unquoted fields are returned as views into
+             * the input; quoted ones as views into a scratch buffer, valid until the next call.
+             */
+            class RecordParser {
+            private:
+                const char *_p;
+                const char *_end;
+                char _delimiter;
+                char _quote;
+                Bool _endOfRecord{False};
+                string _scratch;
+
+                void endField() {
+                    if (_p >= _end) {
+                        _endOfRecord = True;
+                    } else if (*_p == _delimiter) {
+                        _p++;
+                    } else if (*_p == '\n') {
+                        _p++;
+                        _endOfRecord = True;
+                    } else if (*_p == '\r' && _p + 1 < _end && _p[1] == '\n') {
+                        _p += 2;
+                        _endOfRecord = True;
+                    } else {
+                        throw Exception("Unexpected character after a quoted field.");
+                    }
+                }
+
+                std::string_view quoted() {
+                    _scratch.clear();
+                    const char *from = _p + 1;
+                    while (true) {
+                        const char *q = (const char *) memchr(from, _quote, _end - from);
+                        if (q == nullptr) {
+                            throw Exception("Unterminated quoted field.");
+                        }
+
+                        _scratch.append(from, q - from);
+                        if (q + 1 < _end && q[1] == _quote) {
+                            _scratch.push_back(_quote);
+                            from = q + 2;
+                            continue;
+                        }
+
+                        _p = q + 1;
+                        return _scratch;
+                    }
+                }
+
+            public:
+                RecordParser(const char *begin, const char *end, char delimiter, char quote) : _p{begin}, _end{end},
+                                                                                               _delimiter{delimiter},
+                                                                                               _quote{quote} {
+
+                }
+
+                const char *position() const {
+                    return _p;
+                }
+
+                Bool atEnd() const {
+                    return _p >= _end ? True : False;
+                }
+
+                // Consumes the next line if it's empty.
+                Bool skipBlankLine() {
+                    if (*_p == '\n') {
+                        _p++;
+                        return True;
+                    }
+                    if (*_p == '\r' && _p + 1 < _end && _p[1] == '\n') {
+                        _p += 2;
+                        return True;
+                    }
+                    return False;
+                }
+
+                void beginRecord() {
+                    _endOfRecord = False;
+                }
+
+                // The next field of the current record, or std::nullopt once there are no more.
+                std::optional<std::string_view> nextField() {
+                    if (_endOfRecord == True) {
+                        return std::nullopt;
+                    }
+
+                    if (_p < _end && *_p == _quote) {
+                        std::string_view val = quoted();
+                        endField();
+                        return val;
+                    }
+
+                    const char *start = _p;
+                    while (_p < _end && *_p != _delimiter && *_p != '\n') {
+                        _p++;
+                    }
+
+                    std::string_view val{start, (size_t) (_p - start)};
+                    if (val.empty() == false && val.back() == '\r' && (_p == _end || *_p == '\n')) {
+                        val.remove_suffix(1);
+                    }
+                    endField();
+                    return val;
+                }
+
+                // Moves past the rest of the current record. Used after a bad field.
+                void skipRecord() {
+                    try {
+                        while (nextField().has_value()) {
+                        }
+                    } catch (std::exception &) {
+                        // The quotes are broken, fall back to the next line break.
+                        const char *nl = (const char *) memchr(_p, '\n', _end - _p);
+                        _p = nl ? nl + 1 : _end;
+                        _endOfRecord = True;
+                    }
+                }
+            };
+
+            /*
+             * Loads a delimited file (CSV by default) through an INSERT, or any DML, with one placeholder per field. The
+             * file is memory mapped and split at line breaks into one chunk per thread; each thread parses its chunk,
+             * converts the fields to the column types, and executes array DML batches on its own connection.
+             *
+             * A record is rejected when it has the wrong number of fields, a field can't be converted, or the database
+             * refuses the row (batch errors mode). Rejected records are copied as is to the reject file, so it can be
+             * fixed and loaded again, and the reasons go to <rejectFile>.log along with the byte offset of the record.
+             *
+             * Empty fields are bound as NULL. DATETIME fields are YYYY-MM-DD, optionally followed by HH:MM[:SS[.fffffffff]]
+             * separated by a space or a T.
+             *
+             * With more than one thread, quoted fields must not hold line breaks, since the file is split at them.
+             * Commits happen on batch boundaries; if a thread fails, the rows it loaded since its last commit, as well
+             * as the other threads', are rolled back when their connections are released.
+             */
+            class BulkLoader {
+            private:
+                string _sql;
+                std::vector<BulkColumn> _columns;
+                BulkLoadOptions _options;
+
+                std::mutex _rejectMutex;
+                std::unique_ptr<BufferedWriter> _rejects;
+                std::unique_ptr<BufferedWriter> _reasons;
+
+                static void parseDateTime(std::string_view s, dpiTimestamp &ts) {
+                    // Fixed width digits, returns false if any is not a digit.
+                    auto digits = [&s](size_t pos, size_t count, UInt32 &val) {
+                        if (pos + count > s.size()) {
+                            return false;
+                        }
+                        val = 0;
+                        for (size_t i = pos; i < pos + count; i++) {
+                            if (s[i] < '0' || s[i] > '9') {
+                                return false;
+                            }
+                            val = val * 10 + (s[i] - '0');
+                        }
+                        return true;
+                    };
+
+                    UInt32 year, month, day, hour = 0, minute = 0, second = 0, fraction = 0;
+                    bool ok = digits(0, 4, year) && s.size() >= 10 && s[4] == '-' && digits(5, 2, month) &&
+                              s[7] == '-' && digits(8, 2, day);
+
+                    if (ok && s.size() > 10) {
+                        ok = (s[10] == ' ' || s[10] == 'T') && digits(11, 2, hour) && s.size() >= 16 &&
+                             s[13] == ':' && digits(14, 2, minute);
+
+                        if (ok && s.size() > 16) {
+                            ok = s[16] == ':' && digits(17, 2, second);
+                        }
+
+                        if (ok && s.size() > 19) {
+                            size_t count = s.size() - 20;
+                            ok = s[19] == '.' && count >= 1 && count <= 9 && digits(20, count, fraction);
+                            for (size_t i = count; i < 9; i++) {
+                                fraction *= 10;
+                            }
+                        }
+                    }
+
+                    if (ok == false || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 ||
+                        second > 59) {
+                        throw Exception(sfput("'{}' is not a valid date time.", string{s}));
+                    }
+
+                    ts.year = (int16_t) year;
+                    ts.month = (uint8_t) month;
+                    ts.day = (uint8_t) day;
+                    ts.hour = (uint8_t) hour;
+                    ts.minute = (uint8_t) minute;
+                    ts.second = (uint8_t) second;
+                    ts.fsecond = fraction;
+                    ts.tzHourOffset = 0;
+                    ts.tzMinuteOffset = 0;
+                }
+
+                template<typename T>
+                static T parseInteger(std::string_view s) {
+                    T val;
+                    auto res = std::from_chars(s.data(), s.data() + s.size(), val);
+                    if (res.ec != std::errc() || res.ptr != s.data() + s.size()) {
+                        throw Exception(sfput("'{}' is not a valid integer.", string{s}));
+                    }
+                    return val;
+                }
+
+                static double parseDouble(std::string_view s) {
+                    char buf[64];
+                    if (s.size() >= sizeof(buf)) {
+                        throw Exception(sfput("'{}' is not a valid number.", string{s}));
+                    }
+                    memcpy(buf, s.data(), s.size());
+                    buf[s.size()] = '\0';
+
+                    char *end;
+                    double val = strtod(buf, &end);
+                    if (end != buf + s.size()) {
+                        throw Exception(sfput("'{}' is not a valid number.", string{s}));
+                    }
+                    return val;
+                }
+
+                void setField(DBVar &dbVar, UInt32 col, UInt32 row, std::string_view val) {
+                    if (val.empty()) {
+                        dbVar.setNull(row);
+                        return;
+                    }
+
+                    const BulkColumn &column = _columns[col - 1];
+                    switch (column.type) {
+                        case BulkType::INT64:
+                            dbVar.setInt64(row, parseInteger<Int64>(val));
+                            break;
+                        case BulkType::UINT64:
+                            dbVar.setUInt64(row, parseInteger<UInt64>(val));
+                            break;
+                        case BulkType::DOUBLE:
+                            dbVar.setDouble(row, parseDouble(val));
+                            break;
+                        case BulkType::STRING:
+                            if (val.size() > column.maxLength) {
+                                throw Exception(sfput("Field {} is {} bytes long, the maximum is {}.", col, val.size(),
+                                                      column.maxLength));
+                            }
+                            dbVar.setString(row, val);
+                            break;
+                        case BulkType::DATETIME: {
+                            dpiTimestamp ts;
+                            parseDateTime(val, ts);
+                            dbVar.setTimestamp(row, ts);
+                            break;
+                        }
+                    }
+                }
+
+                void reject(std::string_view record, size_t offset, const string &reason) {
+                    if (_rejects == nullptr) {
+                        return;
+                    }
+
+                    std::lock_guard<std::mutex> lock{_rejectMutex};
+                    _rejects->write(record);
+                    _rejects->put('\n');
+                    _reasons->write(sfput("byte {}: {}\n", offset, reason));
+                }
+
+                static std::string_view trimLineBreak(const char *begin, const char *end) {
+                    std::string_view ans{begin, (size_t) (end - begin)};
+                    if (ans.empty() == false && ans.back() == '\n') {
+                        ans.remove_suffix(1);
+                    }
+                    if (ans.empty() == false && ans.back() == '\r') {
+                        ans.remove_suffix(1);
+                    }
+                    return ans;
+                }
+
+                void loadChunk(DBConnection &conn, const char *file, const char *begin, const char *end,
+                               Bool skipHeader, BulkLoadResult &result, std::atomic<bool> &failed) {
+                    const UInt32 batchRows = _options.batchRows;
+                    const UInt32 columnCount = (UInt32) _columns.size();
+
+                    DBStatement stmt = conn.statement(_sql);
+                    std::vector<DBVar *> vars;
+                    for (UInt32 col = 1; col <= columnCount; col++) {
+                        switch (_columns[col - 1].type) {
+                            case BulkType::INT64:
+                                vars.push_back(&stmt.bindArrayInt64(col, batchRows));
+                                break;
+                            case BulkType::UINT64:
+                                vars.push_back(&stmt.bindArrayUInt64(col, batchRows));
+                                break;
+                            case BulkType::DOUBLE:
+                                vars.push_back(&stmt.bindArrayDouble(col, batchRows));
+                                break;
+                            case BulkType::STRING:
+                                vars.push_back(&stmt.bindArrayString(col, batchRows, _columns[col - 1].maxLength));
+                                break;
+                            case BulkType::DATETIME:
+                                vars.push_back(&stmt.bindArrayDateTime(col, batchRows));
+                                break;
+                        }
+                    }
+
+                    // The record of each row in the batch, for the rows the database rejects.
+                    std::vector<std::string_view> records(batchRows);
+                    UInt32 pending = 0;
+                    UInt64 sinceCommit = 0;
+
+                    auto flush = [&]() {
+                        if (pending == 0) {
+                            return;
+                        }
+
+                        stmt.execMany(pending, True);
+                        std::vector<BatchError> errors = stmt.getBatchErrors();
+                        for (BatchError &err: errors) {
+                            std::string_view record = records[err.row - 1];
+                            reject(record, record.data() - file, err.message);
+                        }
+
+                        result.loaded += pending - errors.size();
+                        result.rejected += errors.size();
+                        sinceCommit += pending;
+                        pending = 0;
+
+                        if (_options.commitInterval > 0 && sinceCommit >= _options.commitInterval) {
+                            conn.commit();
+                            sinceCommit = 0;
+                        }
+                    };
+
+                    RecordParser parser{begin, end, _options.delimiter, _options.quote};
+                    if (skipHeader == True && parser.atEnd() == False) {
+                        parser.beginRecord();
+                        parser.skipRecord();
+                    }
+
+                    while (parser.atEnd() == False) {
+                        if (parser.skipBlankLine() == True) {
+                            continue;
+                        }
+
+                        const char *start = parser.position();
+                        result.rows++;
+                        parser.beginRecord();
+
+                        try {
+                            UInt32 col = 0;
+                            while (auto field = parser.nextField()) {
+                                if (++col > columnCount) {
+                                    break;
+                                }
+                                setField(*vars[col - 1], col, pending + 1, *field);
+                            }
+
+                            if (col != columnCount) {
+                                parser.skipRecord();
+                                throw Exception(sfput("Expected {} fields, found {}.", columnCount,
+                                                      col > columnCount ? "more" : std::to_string(col)));
+                            }
+                        } catch (std::exception &ex) {
+                            parser.skipRecord();
+                            reject(trimLineBreak(start, parser.position()), start - file, ex.what());
+                            result.rejected++;
+                            continue;
+                        }
+
+                        records[pending++] = trimLineBreak(start, parser.position());
+                        if (pending == batchRows) {
+                            if (failed.load()) {
+                                return;
+                            }
+                            flush();
+                        }
+                    }
+
+                    if (failed.load()) {
+                        return;
+                    }
+                    flush();
+                    conn.commit();
+                }
+
+                void openRejects() {
+                    if (_options.rejectFile.empty()) {
+                        return;
+                    }
+
+                    _rejects = std::make_unique<BufferedWriter>(_options.rejectFile, _options.rejectBufferSize);
+                    _reasons = std::make_unique<BufferedWriter>(_options.rejectFile + ".log",
+                                                                _options.rejectBufferSize);
+                }
+
+                void closeRejects() {
+                    if (_rejects) {
+                        _rejects->close();
+                        _reasons->close();
+                    }
+                    _rejects.reset();
+                    _reasons.reset();
+                }
+
+            public:
+                BulkLoader(string sql, std::vector<BulkColumn> columns,
+                           BulkLoadOptions options = {}) : _sql{std::move(sql)}, _columns{std::move(columns)},
+                                                           _options{std::move(options)} {
+                    checkParamIsPositive("columns", _columns.size());
+                    checkParamIsPositive("batchRows", _options.batchRows);
+                    checkParamIsPositive("threads", _options.threads);
+
+                    for (UInt32 col = 1; col <= _columns.size(); col++) {
+                        if (_columns[col - 1].type == BulkType::STRING && _columns[col - 1].maxLength == 0) {
+                            throw DBException(sfput("Column {} is a STRING, but has no maxLength.", col));
+                        }
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                BulkLoader(const BulkLoader &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                BulkLoader &operator=(const BulkLoader &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                // Loads the whole file on conn, from the calling thread. The threads option is ignored.
+                BulkLoadResult load(DBConnection &conn, const string &path) {
+                    MappedFile file{path};
+                    const char *begin = file.data();
+
+                    openRejects();
+                    BulkLoadResult result;
+                    std::atomic<bool> failed{false};
+                    try {
+                        loadChunk(conn, begin, begin, begin + file.size(), _options.header, result, failed);
+                    } catch (...) {
+                        closeRejects();
+                        throw;
+                    }
+                    closeRejects();
+                    return result;
+                }
+
+                // Loads the file with the configured number of threads, each one on a connection acquired from pool.
+                BulkLoadResult load(DBPool &pool, const string &path) {
+                    MappedFile file{path};
+                    const char *begin = file.data();
+                    const char *end = begin + file.size();
+
+                    // Chunk boundaries, moved forward to the start of the next line.
+                    UInt32 threads = _options.threads;
+                    std::vector<const char *> bounds{begin};
+                    for (UInt32 i = 1; i < threads; i++) {
+                        const char *p = std::max(bounds.back(), begin + file.size() / threads * i);
+                        const char *nl = p < end ? (const char *) memchr(p, '\n', end - p) : nullptr;
+                        bounds.push_back(nl ? nl + 1 : end);
+                    }
+                    bounds.push_back(end);
+
+                    openRejects();
+                    std::vector<BulkLoadResult> results(threads);
+                    std::vector<std::exception_ptr> errors(threads);
+                    std::atomic<bool> failed{false};
+
+                    std::vector<std::thread> workers;
+                    for (UInt32 i = 0; i < threads; i++) {
+                        workers.emplace_back([&, i]() {
+                            try {
+                                DBConnection conn = pool.acquire();
+                                loadChunk(conn, begin, bounds[i], bounds[i + 1], i == 0 ? _options.header : False,
+                                          results[i], failed);
+                            } catch (...) {
+                                errors[i] = std::current_exception();
+                                failed = true;
+                            }
+                        });
+                    }
+
+                    for (std::thread &worker: workers) {
+                        worker.join();
+                    }
+
+                    closeRejects();
+                    for (std::exception_ptr &err: errors) {
+                        if (err) {
+                            std::rethrow_exception(err);
+                        }
+                    }
+
+                    BulkLoadResult ans;
+                    for (BulkLoadResult &res: results) {
+                        ans.rows += res.rows;
+                        ans.loaded += res.loaded;
+                        ans.rejected += res.rejected;
+                    }
+                    return ans;
+                }
+            };
+        }
+    }
+}
@@ -0,0 +1,855 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include <ylib/db/dpiw.h>
+#include <ylib/db/dpiw/io.h>
+#include <ylib/db/dpiw/queue.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            struct ExportOptions {
+                UInt32 batchRows = 1000; //rows per fetch round trip, and per block handed to the writer
+                UInt32 queueDepth = 8; //blocks in flight between the fetch and the write threads
+                size_t writeBufferSize = 4 * 1024 * 1024; //bytes buffered before each write(2)
+                char delimiter = ','; //CSV only
+                Bool header{True}; //CSV only, column names as the first line
+            };
+
+            /*
+             * A copy of one fetched RowBatch, owned by the block so it can cross threads while the fetch thread moves
+             * on. The cells are kept column-major, and the bytes of every BYTES cell are packed in a single arena.
+             * Blocks are recycled between batches, so after warm up no allocation is made.
+             */
+            struct ExportBlock {
+                UInt32 rowCount = 0;
+                UInt32 columnCount = 0;
+                std::vector<dpiData> cells; //column-major, rowCount * columnCount
+                std::vector<size_t> offsets; //arena offset of each BYTES cell, same index as cells
+                string arena;
+
+                const dpiData &at(UInt32 col, UInt32 row) const {
+                    return cells[(size_t) col * rowCount + row];
+                }
+
+                std::string_view bytes(UInt32 col, UInt32 row) const {
+                    size_t index = (size_t) col * rowCount + row;
+                    return {arena.data() + offsets[index], cells[index].value.asBytes.length};
+                }
+
+                void fill(const RowBatch &batch, const std::vector<dpiNativeTypeNum> &types) {
+                    rowCount = batch.rowCount();
+                    columnCount = batch.columnCount();
+                    cells.resize((size_t) rowCount * columnCount);
+                    offsets.resize(cells.size());
+                    arena.clear();
+
+                    for (UInt32 col = 0; col < columnCount; col++) {
+                        const dpiData *src = batch.column(col + 1);
+                        dpiData *dst = &cells[(size_t) col * rowCount];
+                        std::copy(src, src + rowCount, dst);
+
+                        if (types[col] != DPI_NATIVE_TYPE_BYTES) {
+                            continue;
+                        }
+
+                        size_t *off = &offsets[(size_t) col * rowCount];
+                        for (UInt32 row = 0; row < rowCount; row++) {
+                            if (dst[row].isNull) {
+                                continue;
+                            }
+                            dpiBytes &val = dst[row].value.asBytes;
+                            off[row] = arena.size();
+                            arena.append(val.ptr, val.length);
+                            val.ptr = nullptr; //points into the driver's buffer, not valid after the next fetch
+                        }
+                    }
+                }
+            };
+
+            // How a column is written, resolved once per column from its native and Oracle types.
+            enum class ExportKind {
+                INT64, UINT64, DOUBLE, FLOAT, BOOL, TEXT, BINARY, DATE, TIMESTAMP, TIMESTAMP_TZ
+            };
+
+            inline std::vector<ExportKind> exportKinds(const QueryMetadata &meta,
+                                                       const std::vector<dpiNativeTypeNum> &types) {
+                std::vector<ExportKind> kinds;
+                kinds.reserve(types.size());
+                for (UInt32 col = 1; col <= types.size(); col++) {
+                    const ColumnInfo &info = meta.column(col);
+                    dpiOracleTypeNum oracleType = info.typeInfo.oracleTypeNum;
+
+                    switch (types[col - 1]) {
+                        case DPI_NATIVE_TYPE_INT64:
+                            kinds.push_back(ExportKind::INT64);
+                            continue;
+                        case DPI_NATIVE_TYPE_UINT64:
+                            kinds.push_back(ExportKind::UINT64);
+                            continue;
+                        case DPI_NATIVE_TYPE_DOUBLE:
+                            kinds.push_back(ExportKind::DOUBLE);
+                            continue;
+                        case DPI_NATIVE_TYPE_FLOAT:
+                            kinds.push_back(ExportKind::FLOAT);
+                            continue;
+                        case DPI_NATIVE_TYPE_BOOLEAN:
+                            kinds.push_back(ExportKind::BOOL);
+                            continue;
+                        case DPI_NATIVE_TYPE_BYTES:
+                            kinds.push_back(oracleType == DPI_ORACLE_TYPE_RAW ||
+                                            oracleType == DPI_ORACLE_TYPE_LONG_RAW ||
+                                            oracleType == DPI_ORACLE_TYPE_BLOB ? ExportKind::BINARY
+                                                                               : ExportKind::TEXT);
+                            continue;
+                        case DPI_NATIVE_TYPE_TIMESTAMP:
+                            kinds.push_back(oracleType == DPI_ORACLE_TYPE_DATE ? ExportKind::DATE :
+                                            oracleType == DPI_ORACLE_TYPE_TIMESTAMP ? ExportKind::TIMESTAMP
+                                                                                    : ExportKind::TIMESTAMP_TZ);
+                            continue;
+                        default:
+                            throw DBException(sfput("Column {} ({}) can not be exported. The dpiNativeTypeNum is: {}.",
+                                                    col, info.name, types[col - 1]));
+                    }
+                }
+                return kinds;
+            }
+
+            /*
+             * RFC 4180 CSV. NULL is an empty field, text is quoted only when it holds the delimiter, a quote or a line
+             * break, binary is hex encoded, and timestamps are ISO 8601 like.
+             */
+            class CsvEncoder {
+            private:
+                BufferedWriter &_out;
+                char _delimiter;
+                Bool _header;
+                std::vector<ExportKind> _kinds;
+
+                template<typename T>
+                void number(T val) {
+                    char buf[64];
+                    auto res = std::to_chars(buf, buf + sizeof(buf), val);
+                    _out.write(buf, res.ptr - buf);
+                }
+
+                static char *digits(char *p, UInt32 val, int width) {
+                    for (int i = width - 1; i >= 0; i--) {
+                        p[i] = (char) ('0' + val % 10);
+                        val /= 10;
+                    }
+                    return p + width;
+                }
+
+                void timestamp(const dpiTimestamp &ts, ExportKind kind) {
+                    char buf[40];
+                    char *p = buf;
+                    if (ts.year < 0) {
+                        *p++ = '-';
+                    }
+                    p = digits(p, (UInt32) std::abs(ts.year), 4);
+                    *p++ = '-';
+                    p = digits(p, ts.month, 2);
+                    *p++ = '-';
+                    p = digits(p, ts.day, 2);
+                    *p++ = ' ';
+                    p = digits(p, ts.hour, 2);
+                    *p++ = ':';
+                    p = digits(p, ts.minute, 2);
+                    *p++ = ':';
+                    p = digits(p, ts.second, 2);
+
+                    if (kind != ExportKind::DATE) {
+                        *p++ = '.';
+                        p = digits(p, ts.fsecond / 1000, 6);
+                    }
+
+                    if (kind == ExportKind::TIMESTAMP_TZ) {
+                        Int32 offset = ts.tzHourOffset * 60 + ts.tzMinuteOffset;
+                        *p++ = offset < 0 ? '-' : '+';
+                        offset = std::abs(offset);
+                        p = digits(p, offset / 60, 2);
+                        *p++ = ':';
+                        p = digits(p, offset % 60, 2);
+                    }
+                    _out.write(buf, p - buf);
+                }
+
+                void text(std::string_view val) {
+                    bool quote = false;
+                    for (char c: val) {
+                        if (c == _delimiter || c == '"' || c == '\n' || c == '\r') {
+                            quote = true;
+                            break;
+                        }
+                    }
+
+                    if (quote == false) {
+                        _out.write(val);
+                        return;
+                    }
+
+                    _out.put('"');
+                    size_t start = 0;
+                    for (size_t i = 0; i < val.size(); i++) {
+                        if (val[i] == '"') {
+                            _out.write(val.substr(start, i - start + 1));
+                            _out.put('"');
+                            start = i + 1;
+                        }
+                    }
+                    _out.write(val.substr(start));
+                    _out.put('"');
+                }
+
+                void binary(std::string_view val) {
+                    static const char hex[] = "0123456789ABCDEF";
+                    for (char c: val) {
+                        _out.put(hex[((unsigned char) c) >> 4]);
+                        _out.put(hex[((unsigned char) c) & 0x0F]);
+                    }
+                }
+
+            public:
+                CsvEncoder(BufferedWriter &out, const ExportOptions &options) : _out{out},
+                                                                              _delimiter{options.delimiter},
+                                                                              _header{options.header} {
+
+                }
+
+                void begin(const QueryMetadata &meta, const std::vector<dpiNativeTypeNum> &types) {
+                    _kinds = exportKinds(meta, types);
+
+                    if (_header == False) {
+                        return;
+                    }
+
+                    for (UInt32 col = 1; col <= meta.columnCount(); col++) {
+                        if (col > 1) {
+                            _out.put(_delimiter);
+                        }
+                        text(meta.column(col).name);
+                    }
+                    _out.put('\n');
+                }
+
+                void encode(const ExportBlock &block) {
+                    for (UInt32 row = 0; row < block.rowCount; row++) {
+                        for (UInt32 col = 0; col < block.columnCount; col++) {
+                            if (col > 0) {
+                                _out.put(_delimiter);
+                            }
+
+                            const dpiData &cell = block.at(col, row);
+                            if (cell.isNull) {
+                                continue;
+                            }
+
+                            switch (_kinds[col]) {
+                                case ExportKind::INT64:
+                                    number(cell.value.asInt64);
+                                    break;
+                                case ExportKind::UINT64:
+                                    number(cell.value.asUint64);
+                                    break;
+                                case ExportKind::DOUBLE:
+                                    number(cell.value.asDouble);
+                                    break;
+                                case ExportKind::FLOAT:
+                                    number(cell.value.asFloat);
+                                    break;
+                                case ExportKind::BOOL:
+                                    _out.write(cell.value.asBoolean ? "true" : "false");
+                                    break;
+                                case ExportKind::TEXT:
+                                    text(block.bytes(col, row));
+                                    break;
+                                case ExportKind::BINARY:
+                                    binary(block.bytes(col, row));
+                                    break;
+                                case ExportKind::DATE:
+                                case ExportKind::TIMESTAMP:
+                                case ExportKind::TIMESTAMP_TZ:
+                                    timestamp(cell.value.asTimestamp, _kinds[col]);
+                                    break;
+                            }
+                        }
+                        _out.put('\n');
+                    }
+                }
+
+                void end() {
+                    _out.flush();
+                }
+            };
+
+            /*
+             * Just enough of a FlatBuffers builder to emit the Arrow IPC metadata. Unlike the official builder it writes
+             * front to back: a parent is written first with placeholder offsets, which are patched once the children
+             * (always at higher addresses, as uoffset_t requires) are written. Each vtable is placed right before its
+             * table. Assumes a little endian host.
+             */
+            class FlatBufferWriter {
+            private:
+                string _buf;
+
+            public:
+                struct Field {
+                    UInt16 id;
+                    UInt8 size; //1, 2, 4 or 8 bytes
+                    UInt64 value;
+                    Bool offset{False}; //a uoffset_t to patch later, value is ignored
+                };
+
+                const string &data() const {
+                    return _buf;
+                }
+
+                void align(size_t alignment) {
+                    while (_buf.size() % alignment != 0) {
+                        _buf.push_back('\0');
+                    }
+                }
+
+                template<typename T>
+                size_t put(T val) {
+                    size_t pos = _buf.size();
+                    _buf.append((const char *) &val, sizeof(T));
+                    return pos;
+                }
+
+                // Points the uoffset_t at slot to target.
+                void patch(size_t slot, size_t target) {
+                    uint32_t val = (uint32_t) (target - slot);
+                    std::memcpy(&_buf[slot], &val, sizeof(val));
+                }
+
+                /*
+                 * Writes a table and returns its position. The positions of the offset fields are appended to slots,
+                 * in the order they were given.
+                 */
+                size_t table(std::vector<Field> fields, std::vector<size_t> &slots) {
+                    UInt16 numSlots = 0;
+                    size_t alignment = 4;
+                    for (Field &f: fields) {
+                        numSlots = std::max<UInt16>(numSlots, f.id + 1);
+                        alignment = std::max<size_t>(alignment, f.size);
+                    }
+
+                    // Biggest fields first, so they line up without padding.
+                    std::vector<size_t> order(fields.size());
+                    for (size_t i = 0; i < order.size(); i++) {
+                        order[i] = i;
+                    }
+                    std::stable_sort(order.begin(), order.end(), [&fields](size_t a, size_t b) {
+                        return fields[a].size > fields[b].size;
+                    });
+
+                    std::vector<UInt16> inlineOffsets(fields.size());
+                    UInt16 tableSize = 4; //soffset_t to the vtable
+                    for (size_t i: order) {
+                        UInt16 size = fields[i].size;
+                        tableSize = (UInt16) ((tableSize + size - 1) / size * size);
+                        inlineOffsets[i] = tableSize;
+                        tableSize += size;
+                    }
+
+                    align(2);
+                    size_t vtable = put<UInt16>((UInt16) (4 + 2 * numSlots));
+                    put<UInt16>(tableSize);
+                    std::vector<UInt16> vtableSlots(numSlots, 0);
+                    for (size_t i = 0; i < fields.size(); i++) {
+                        vtableSlots[fields[i].id] = inlineOffsets[i];
+                    }
+                    for (UInt16 slot: vtableSlots) {
+                        put<UInt16>(slot);
+                    }
+
+                    align(alignment);
+                    size_t table = put<int32_t>((int32_t) (_buf.size() - vtable));
+                    _buf.resize(table + tableSize, '\0');
+                    for (size_t i = 0; i < fields.size(); i++) {
+                        size_t pos = table + inlineOffsets[i];
+                        if (fields[i].offset == True) {
+                            slots.push_back(pos);
+                        } else {
+                            std::memcpy(&_buf[pos], &fields[i].value, fields[i].size);
+                        }
+                    }
+                    return table;
+                }
+
+                // A vector of uoffset_t, one slot per element to patch later.
+                size_t offsetVector(UInt32 count, std::vector<size_t> &slots) {
+                    align(4);
+                    size_t pos = put<uint32_t>(count);
+                    for (UInt32 i = 0; i < count; i++) {
+                        slots.push_back(put<uint32_t>(0));
+                    }
+                    return pos;
+                }
+
+                template<typename S>
+                size_t structVector(const std::vector<S> &items) {
+                    // The elements, right after the length, must be aligned to 8 for Arrow's int64 structs.
+                    align(4);
+                    if ((_buf.size() + 4) % 8 != 0) {
+                        put<uint32_t>(0);
+                    }
+
+                    size_t pos = put<uint32_t>((uint32_t) items.size());
+                    _buf.append((const char *) items.data(), items.size() * sizeof(S));
+                    return pos;
+                }
+
+                size_t str(std::string_view val) {
+                    align(4);
+                    size_t pos = put<uint32_t>((uint32_t) val.size());
+                    _buf.append(val.data(), val.size());
+                    _buf.push_back('\0');
+                    return pos;
+                }
+            };
+
+            /*
+             * Arrow IPC streaming format (https://arrow.apache.org/docs/format/Columnar.html#ipc-streaming-format): a
+             * Schema message, then one RecordBatch message per block, then the end of stream marker. Timestamps are
+             * written in microseconds; TIMESTAMP WITH (LOCAL) TIME ZONE columns are normalized to UTC.
+             */
+            class ArrowEncoder {
+            private:
+                // Arrow's Message.fbs / Schema.fbs constants
+                static constexpr UInt64 METADATA_V5 = 4;
+                static constexpr UInt64 HEADER_SCHEMA = 1;
+                static constexpr UInt64 HEADER_RECORD_BATCH = 3;
+                static constexpr UInt64 TYPE_INT = 2;
+                static constexpr UInt64 TYPE_FLOATING_POINT = 3;
+                static constexpr UInt64 TYPE_BINARY = 4;
+                static constexpr UInt64 TYPE_UTF8 = 5;
+                static constexpr UInt64 TYPE_BOOL = 6;
+                static constexpr UInt64 TYPE_TIMESTAMP = 10;
+                static constexpr UInt64 PRECISION_SINGLE = 1;
+                static constexpr UInt64 PRECISION_DOUBLE = 2;
+                static constexpr UInt64 UNIT_MICROSECOND = 2;
+
+                struct FieldNode {
+                    Int64 length;
+                    Int64 nullCount;
+                };
+
+                struct Buffer {
+                    Int64 offset;
+                    Int64 length;
+                };
+
+                BufferedWriter &_out;
+                std::vector<ExportKind> _kinds;
+
+                //reused between blocks
+                string _body;
+                std::vector<FieldNode> _nodes;
+                std::vector<Buffer> _buffers;
+
+                void addBuffer(const char *data, size_t len) {
+                    Int64 offset = (Int64) _body.size();
+                    _body.append(data, len);
+                    _body.resize((_body.size() + 7) / 8 * 8, '\0');
+                    _buffers.push_back({offset, (Int64) len});
+                }
+
+                template<typename T>
+                void addValues(const std::vector<T> &values) {
+                    addBuffer((const char *) values.data(), values.size() * sizeof(T));
+                }
+
+                void message(const string &meta, Int64 bodyLength) {
+                    size_t padded = (meta.size() + 7) / 8 * 8;
+                    uint32_t continuation = 0xFFFFFFFF;
+                    int32_t length = (int32_t) padded;
+                    _out.write((const char *) &continuation, 4);
+                    _out.write((const char *) &length, 4);
+                    _out.write(meta);
+                    for (size_t i = meta.size(); i < padded; i++) {
+                        _out.put('\0');
+                    }
+
+                    if (bodyLength > 0) {
+                        _out.write(_body);
+                    }
+                }
+
+                // The Message table, returns the slot of its header.
+                static size_t messageTable(FlatBufferWriter &fb, UInt64 headerType, Int64 bodyLength) {
+                    size_t root = fb.put<uint32_t>(0);
+                    std::vector<size_t> slots;
+                    size_t table = fb.table({{0, 2, METADATA_V5},
+                                             {1, 1, headerType},
+                                             {2, 4, 0, True},
+                                             {3, 8, (UInt64) bodyLength}}, slots);
+                    fb.patch(root, table);
+                    return slots[0];
+                }
+
+                static UInt64 typeType(ExportKind kind) {
+                    switch (kind) {
+                        case ExportKind::INT64:
+                        case ExportKind::UINT64:
+                            return TYPE_INT;
+                        case ExportKind::DOUBLE:
+                        case ExportKind::FLOAT:
+                            return TYPE_FLOATING_POINT;
+                        case ExportKind::BOOL:
+                            return TYPE_BOOL;
+                        case ExportKind::TEXT:
+                            return TYPE_UTF8;
+                        case ExportKind::BINARY:
+                            return TYPE_BINARY;
+                        default: //DATE, TIMESTAMP, TIMESTAMP_TZ
+                            return TYPE_TIMESTAMP;
+                    }
+                }
+
+                static size_t typeTable(FlatBufferWriter &fb, ExportKind kind) {
+                    std::vector<size_t> slots;
+                    switch (kind) {
+                        case ExportKind::INT64:
+                        case ExportKind::UINT64:
+                            return fb.table({{0, 4, 64},
+                                             {1, 1, kind == ExportKind::INT64 ? 1u : 0u}}, slots);
+                        case ExportKind::DOUBLE:
+                        case ExportKind::FLOAT:
+                            return fb.table({{0, 2, kind == ExportKind::DOUBLE ? PRECISION_DOUBLE
+                                                                               : PRECISION_SINGLE}}, slots);
+                        case ExportKind::TIMESTAMP_TZ: {
+                            size_t table = fb.table({{0, 2, UNIT_MICROSECOND},
+                                                     {1, 4, 0, True}}, slots);
+                            fb.patch(slots[0], fb.str("UTC"));
+                            return table;
+                        }
+                        case ExportKind::DATE:
+                        case ExportKind::TIMESTAMP:
+                            return fb.table({{0, 2, UNIT_MICROSECOND}}, slots);
+                        default: //BOOL, TEXT and BINARY have no fields
+                            return fb.table({}, slots);
+                    }
+                }
+
+                void validity(const ExportBlock &block, UInt32 col, Int64 nullCount) {
+                    if (nullCount == 0) {
+                        _buffers.push_back({(Int64) _body.size(), 0});
+                        return;
+                    }
+
+                    string bits((block.rowCount + 7) / 8, '\0');
+                    for (UInt32 row = 0; row < block.rowCount; row++) {
+                        if (block.at(col, row).isNull == 0) {
+                            bits[row / 8] = (char) (bits[row / 8] | (1 << (row % 8)));
+                        }
+                    }
+                    addBuffer(bits.data(), bits.size());
+                }
+
+                void column(const ExportBlock &block, UInt32 col) {
+                    Int64 nullCount = 0;
+                    for (UInt32 row = 0; row < block.rowCount; row++) {
+                        nullCount += block.at(col, row).isNull ? 1 : 0;
+                    }
+
+                    _nodes.push_back({(Int64) block.rowCount, nullCount});
+                    validity(block, col, nullCount);
+
+                    ExportKind kind = _kinds[col];
+                    switch (kind) {
+                        case ExportKind::INT64:
+                        case ExportKind::UINT64: {
+                            std::vector<Int64> values(block.rowCount, 0);
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                const dpiData &cell = block.at(col, row);
+                                if (cell.isNull == 0) {
+                                    values[row] = cell.value.asInt64; //same bits for asUint64
+                                }
+                            }
+                            addValues(values);
+                            break;
+                        }
+                        case ExportKind::DOUBLE: {
+                            std::vector<double> values(block.rowCount, 0);
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                const dpiData &cell = block.at(col, row);
+                                if (cell.isNull == 0) {
+                                    values[row] = cell.value.asDouble;
+                                }
+                            }
+                            addValues(values);
+                            break;
+                        }
+                        case ExportKind::FLOAT: {
+                            std::vector<float> values(block.rowCount, 0);
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                const dpiData &cell = block.at(col, row);
+                                if (cell.isNull == 0) {
+                                    values[row] = cell.value.asFloat;
+                                }
+                            }
+                            addValues(values);
+                            break;
+                        }
+                        case ExportKind::BOOL: {
+                            string bits((block.rowCount + 7) / 8, '\0');
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                const dpiData &cell = block.at(col, row);
+                                if (cell.isNull == 0 && cell.value.asBoolean) {
+                                    bits[row / 8] = (char) (bits[row / 8] | (1 << (row % 8)));
+                                }
+                            }
+                            addBuffer(bits.data(), bits.size());
+                            break;
+                        }
+                        case ExportKind::TEXT:
+                        case ExportKind::BINARY: {
+                            std::vector<int32_t> offsets(block.rowCount + 1, 0);
+                            string data;
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                if (block.at(col, row).isNull == 0) {
+                                    std::string_view val = block.bytes(col, row);
+                                    data.append(val.data(), val.size());
+                                }
+                                offsets[row + 1] = (int32_t) data.size();
+                            }
+                            addValues(offsets);
+                            addBuffer(data.data(), data.size());
+                            break;
+                        }
+                        case ExportKind::DATE:
+                        case ExportKind::TIMESTAMP:
+                        case ExportKind::TIMESTAMP_TZ: {
+                            std::vector<Int64> values(block.rowCount, 0);
+                            for (UInt32 row = 0; row < block.rowCount; row++) {
+                                const dpiData &cell = block.at(col, row);
+                                if (cell.isNull == 0) {
+                                    values[row] = timestampToEpochMicros(cell.value.asTimestamp);
+                                }
+                            }
+                            addValues(values);
+                            break;
+                        }
+                    }
+                }
+
+            public:
+                ArrowEncoder(BufferedWriter &out, const ExportOptions &) : _out{out} {
+
+                }
+
+                void begin(const QueryMetadata &meta, const std::vector<dpiNativeTypeNum> &types) {
+                    _kinds = exportKinds(meta, types);
+
+                    FlatBufferWriter fb;
+                    size_t header = messageTable(fb, HEADER_SCHEMA, 0);
+
+                    std::vector<size_t> slots;
+                    size_t schema = fb.table({{1, 4, 0, True}}, slots);
+                    fb.patch(header, schema);
+
+                    std::vector<size_t> fieldSlots;
+                    fb.patch(slots[0], fb.offsetVector(meta.columnCount(), fieldSlots));
+
+                    for (UInt32 col = 1; col <= meta.columnCount(); col++) {
+                        const ColumnInfo &info = meta.column(col);
+                        ExportKind kind = _kinds[col - 1];
+
+                        slots.clear();
+                        size_t field = fb.table({{0, 4, 0, True}, //name
+                                                 {1, 1, info.nullable == True ? 1u : 0u},
+                                                 {2, 1, typeType(kind)},
+                                                 {3, 4, 0, True}, //type
+                                                 {5, 4, 0, True}}, slots); //children, required by Arrow readers
+                        fb.patch(fieldSlots[col - 1], field);
+                        size_t nameSlot = slots[0];
+                        size_t typeSlot = slots[1];
+                        size_t childrenSlot = slots[2];
+
+                        fb.patch(nameSlot, fb.str(info.name));
+                        fb.patch(typeSlot, typeTable(fb, kind));
+
+                        std::vector<size_t> none;
+                        fb.patch(childrenSlot, fb.offsetVector(0, none));
+                    }
+
+                    message(fb.data(), 0);
+                }
+
+                void encode(const ExportBlock &block) {
+                    _body.clear();
+                    _nodes.clear();
+                    _buffers.clear();
+                    for (UInt32 col = 0; col < block.columnCount; col++) {
+                        column(block, col);
+                    }
+
+                    FlatBufferWriter fb;
+                    size_t header = messageTable(fb, HEADER_RECORD_BATCH, (Int64) _body.size());
+
+                    std::vector<size_t> slots;
+                    size_t batch = fb.table({{0, 8, block.rowCount},
+                                             {1, 4, 0, True},
+                                             {2, 4, 0, True}}, slots);
+                    fb.patch(header, batch);
+                    fb.patch(slots[0], fb.structVector(_nodes));
+                    fb.patch(slots[1], fb.structVector(_buffers));
+
+                    message(fb.data(), (Int64) _body.size());
+                }
+
+                void end() {
+                    uint32_t continuation = 0xFFFFFFFF;
+                    uint32_t eos = 0;
+                    _out.write((const char *) &continuation, 4);
+                    _out.write((const char *) &eos, 4);
+                    _out.flush();
+                }
+            };
+
+            /*
+             * Streams the rows of rs through encoder. The calling thread fetches, and copies each batch into an
+             * ExportBlock; a second thread encodes and writes them. The two are connected by a bounded queue of
+             * queueDepth blocks, and the blocks go back to the fetch thread once written.
+             *
+             * Must be called before any row of rs is fetched. LOB columns are fetched inline. Returns the number of
+             * rows exported.
+             */
+            template<typename Encoder>
+            UInt64 exportResultSet(ResultSet &rs, Encoder &encoder, const ExportOptions &options) {
+                checkParamIsPositive("batchRows", options.batchRows);
+                checkParamIsPositive("queueDepth", options.queueDepth);
+
+                if (rs.columnCount() == 0) {
+                    throw DBException("Only queries can be exported.");
+                }
+                rs.inlineLobs();
+
+                RowBatch batch = rs.nextBatch(options.batchRows);
+                std::vector<dpiNativeTypeNum> types;
+                for (UInt32 col = 1; col <= rs.columnCount(); col++) {
+                    types.push_back(batch.nativeTypeNum(col));
+                }
+                encoder.begin(rs.metadata(), types);
+
+                // One more block than the queue holds, so the fetch thread can fill one while the queue is full.
+                BoundedQueue<std::unique_ptr<ExportBlock>> full{options.queueDepth};
+                BoundedQueue<std::unique_ptr<ExportBlock>> empty{options.queueDepth + 1};
+                for (UInt32 i = 0; i <= options.queueDepth; i++) {
+                    empty.push(std::make_unique<ExportBlock>());
+                }
+
+                std::exception_ptr writeError;
+                std::thread writer([&]() {
+                    try {
+                        while (auto block = full.pop()) {
+                            encoder.encode(**block);
+                            empty.push(std::move(*block));
+                        }
+                    } catch (...) {
+                        writeError = std::current_exception();
+                        full.close();
+                        empty.close();
+                    }
+                });
+
+                UInt64 rows = 0;
+                std::exception_ptr fetchError;
+                try {
+                    for (; batch.empty() == False; batch = rs.nextBatch(options.batchRows)) {
+                        auto block = empty.pop();
+                        if (block.has_value() == false) {
+                            break; //the writer failed
+                        }
+
+                        (*block)->fill(batch, types);
+                        rows += batch.rowCount();
+                        if (full.push(std::move(*block)) == False) {
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    fetchError = std::current_exception();
+                }
+
+                full.close();
+                writer.join();
+
+                if (fetchError) {
+                    std::rethrow_exception(fetchError);
+                }
+                if (writeError) {
+                    std::rethrow_exception(writeError);
+                }
+
+                encoder.end();
+                return rows;
+            }
+
+            // Runs the query and exports it, see exportResultSet. It's fetched options.batchRows rows per round trip,
+            // and the statement gets its own fetch array size back afterwards.
+            template<typename Encoder>
+            UInt64 exportQuery(DBStatement &stmt, Encoder &encoder, const ExportOptions &options) {
+                checkParamIsPositive("batchRows", options.batchRows);
+
+                UInt32 fetchArraySize = stmt.getFetchArraySize();
+                UInt64 rows;
+                try {
+                    ResultSet rs = stmt.execQuery();
+                    rs.setFetchArraySize(options.batchRows);
+                    rows = exportResultSet(rs, encoder, options);
+                } catch (...) {
+                    stmt.setFetchArraySize(fetchArraySize);
+                    throw;
+                }
+                stmt.setFetchArraySize(fetchArraySize);
+                return rows;
+            }
+
+            inline UInt64 exportCsv(DBStatement &stmt, std::ostream &out, const ExportOptions &options = {}) {
+                BufferedWriter writer{out, options.writeBufferSize};
+                CsvEncoder encoder{writer, options};
+                UInt64 rows = exportQuery(stmt, encoder, options);
+                writer.close();
+                return rows;
+            }
+
+            inline UInt64 exportCsv(DBStatement &stmt, const string &path, const ExportOptions &options = {}) {
+                BufferedWriter writer{path, options.writeBufferSize};
+                CsvEncoder encoder{writer, options};
+                UInt64 rows = exportQuery(stmt, encoder, options);
+                writer.close();
+                return rows;
+            }
+
+            inline UInt64 exportArrowIpc(DBStatement &stmt, std::ostream &out, const ExportOptions &options = {}) {
+                BufferedWriter writer{out, options.writeBufferSize};
+                ArrowEncoder encoder{writer, options};
+                UInt64 rows = exportQuery(stmt, encoder, options);
+                writer.close();
+                return rows;
+            }
+
+            inline UInt64 exportArrowIpc(DBStatement &stmt, const string &path, const ExportOptions &options = {}) {
+                BufferedWriter writer{path, options.writeBufferSize};
+                ArrowEncoder encoder{writer, options};
+                UInt64 rows = exportQuery(stmt, encoder, options);
+                writer.close();
+                return rows;
+            }
+        }
+    }
+}
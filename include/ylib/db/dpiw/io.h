@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ylib/db/dpiw.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            /*
+             * Output with a large buffer in front, so the encoders can emit small pieces while the file only sees a
+             * few big write(2) calls. Writes bigger than the buffer go straight through.
+             */
+            class BufferedWriter {
+            private:
+                int _fd = -1;
+                std::ostream *_out = nullptr; //not owned
+                string _name;
+                string _buffer;
+                size_t _capacity;
+
+                void writeFully(const char *data, size_t len) {
+                    if (_out) {
+                        _out->write(data, (std::streamsize) len);
+                        if (!*_out) {
+                            throw Exception(sfput("Could not write to {}.", _name));
+                        }
+                        return;
+                    }
+
+                    while (len > 0) {
+                        ssize_t written = ::write(_fd, data, len);
+                        if (written < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            throw Exception(sfput("Could not write to {}: {}.", _name, strerror(errno)));
+                        }
+                        data += written;
+                        len -= (size_t) written;
+                    }
+                }
+
+            public:
+                BufferedWriter(const string &path, size_t capacity) : _name{path}, _capacity{capacity} {
+                    checkParamIsPositive("capacity", capacity);
+
+                    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                    if (_fd < 0) {
+                        throw Exception(sfput("Could not open {}: {}.", path, strerror(errno)));
+                    }
+                    _buffer.reserve(_capacity);
+                }
+
+                BufferedWriter(std::ostream &out, size_t capacity) : _out{&out}, _name{"std::ostream"},
+                                                                     _capacity{capacity} {
+                    checkParamIsPositive("capacity", capacity);
+                    _buffer.reserve(_capacity);
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                BufferedWriter(const BufferedWriter &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                BufferedWriter &operator=(const BufferedWriter &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                void write(const char *data, size_t len) {
+                    if (_buffer.size() + len > _capacity) {
+                        flush();
+                    }
+
+                    if (len >= _capacity) {
+                        writeFully(data, len);
+                        return;
+                    }
+                    _buffer.append(data, len);
+                }
+
+                void write(std::string_view data) {
+                    write(data.data(), data.size());
+                }
+
+                void put(char c) {
+                    if (_buffer.size() == _capacity) {
+                        flush();
+                    }
+                    _buffer.push_back(c);
+                }
+
+                void flush() {
+                    if (_buffer.empty() == false) {
+                        writeFully(_buffer.data(), _buffer.size());
+                        _buffer.clear();
+                    }
+
+                    if (_out) {
+                        _out->flush();
+                    }
+                }
+
+                void close() {
+                    flush();
+
+                    if (_fd >= 0) {
+                        int fd = _fd;
+                        _fd = -1;
+                        if (::close(fd) < 0) {
+                            throw Exception(sfput("Could not close {}: {}.", _name, strerror(errno)));
+                        }
+                    }
+                }
+
+                virtual ~BufferedWriter() {
+                    try {
+                        close();
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+            };
+
+            /*
+             * A read-only, private memory mapping of a whole file. The pages are loaded on demand as the data is read, so
+             * the file is never copied into the process; madvise tells the kernel the access is sequential.
+             */
+            class MappedFile {
+            private:
+                const char *_data = nullptr;
+                size_t _size = 0;
+
+            public:
+                explicit MappedFile(const string &path) {
+                    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0) {
+                        throw Exception(sfput("Could not open {}: {}.", path, strerror(errno)));
+                    }
+
+                    struct stat st;
+                    if (::fstat(fd, &st) < 0) {
+                        int err = errno;
+                        ::close(fd);
+                        throw Exception(sfput("Could not stat {}: {}.", path, strerror(err)));
+                    }
+
+                    _size = (size_t) st.st_size;
+                    if (_size > 0) {
+                        void *addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (addr == MAP_FAILED) {
+                            int err = errno;
+                            ::close(fd);
+                            throw Exception(sfput("Could not map {}: {}.", path, strerror(err)));
+                        }
+                        ::madvise(addr, _size, MADV_SEQUENTIAL);
+                        _data = (const char *) addr;
+                    }
+
+                    // The mapping stays valid after the descriptor is closed.
+                    ::close(fd);
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                MappedFile(const MappedFile &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                MappedFile &operator=(const MappedFile &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Implemented
+                // =========================================================================
+
+                const char *data() const {
+                    return _data;
+                }
+
+                size_t size() const {
+                    return _size;
+                }
+
+                virtual ~MappedFile() {
+                    if (_data) {
+                        ::munmap((void *) _data, _size);
+                    }
+                }
+            };
+        }
+    }
+}
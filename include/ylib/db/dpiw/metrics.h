@@ -0,0 +1,317 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <ylib/core/lang.h>
+
+using namespace ylib::core;
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            inline UInt64 monotonicNanos() {
+                return (UInt64) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            struct HistogramSnapshot {
+                static constexpr UInt32 BUCKETS = 28;
+
+                std::array<UInt64, BUCKETS + 1> buckets{}; //not cumulative, the last one is +Inf
+                UInt64 count = 0;
+                UInt64 sumNanos = 0;
+
+                // Upper bound of bucket i, in seconds: 1us, 2us, 4us, ... 2^27us (about 134s).
+                static double upperBound(UInt32 i) {
+                    return (double) (1ULL << i) / 1e6;
+                }
+            };
+
+            /*
+             * Latency histogram with power of two buckets, from 1us up. Recording is lock free, with relaxed atomics: a
+             * snapshot taken while others record may be off by the samples in flight, which is fine for metrics.
+             */
+            class LatencyHistogram {
+            private:
+                std::array<std::atomic<UInt64>, HistogramSnapshot::BUCKETS + 1> _buckets;
+                std::atomic<UInt64> _count{0};
+                std::atomic<UInt64> _sumNanos{0};
+
+            public:
+                LatencyHistogram() {
+                    for (std::atomic<UInt64> &bucket: _buckets) {
+                        bucket.store(0, std::memory_order_relaxed);
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                LatencyHistogram(const LatencyHistogram &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                LatencyHistogram &operator=(const LatencyHistogram &other) = delete;
+                // =========================================================================
+
+                void record(UInt64 nanos) {
+                    // The smallest bucket whose bound is >= the elapsed micros, rounded up.
+                    UInt64 micros = (nanos + 999) / 1000;
+                    UInt32 index = micros <= 1 ? 0 : 64 - __builtin_clzll(micros - 1);
+                    if (index > HistogramSnapshot::BUCKETS) {
+                        index = HistogramSnapshot::BUCKETS;
+                    }
+
+                    _buckets[index].fetch_add(1, std::memory_order_relaxed);
+                    _count.fetch_add(1, std::memory_order_relaxed);
+                    _sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+                }
+
+                HistogramSnapshot snapshot() const {
+                    HistogramSnapshot ans;
+                    for (UInt32 i = 0; i <= HistogramSnapshot::BUCKETS; i++) {
+                        ans.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+                    }
+                    ans.count = _count.load(std::memory_order_relaxed);
+                    ans.sumNanos = _sumNanos.load(std::memory_order_relaxed);
+                    return ans;
+                }
+            };
+
+            // Counters of one SQL text, or statement tag.
+            struct StatementMetrics {
+                LatencyHistogram prepare; //includes the statement cache hits
+                LatencyHistogram execute;
+                LatencyHistogram fetch; //one sample per ResultSet, the time spent in all of its fetch calls
+                std::atomic<UInt64> rows{0}; //fetched
+                std::atomic<UInt64> bytes{0}; //fetched, of string and raw values
+                std::atomic<UInt64> binds{0};
+            };
+
+            struct StatementMetricsSnapshot {
+                string key;
+                HistogramSnapshot prepare;
+                HistogramSnapshot execute;
+                HistogramSnapshot fetch;
+                UInt64 rows;
+                UInt64 bytes;
+                UInt64 binds;
+            };
+
+            struct MetricsSnapshot {
+                std::vector<StatementMetricsSnapshot> statements;
+                HistogramSnapshot commit;
+            };
+
+            /*
+             * Registry of per statement metrics, shared by any number of connections and threads. Attach it with
+             * DBConnection::setMetrics or DBPool::setMetrics; while none is attached, the only cost left is a null check.
+             *
+             * Statements are keyed by their SQL text, unless tagged (DBStatement::setTag). Every distinct key is kept
+             * until the registry is destroyed, so tag statements whose SQL text is built on the fly.
+             */
+            class DBMetrics {
+            private:
+                std::mutex _mutex;
+                std::unordered_map<string, std::unique_ptr<StatementMetrics>> _statements;
+                LatencyHistogram _commit;
+
+                static void escapeLabel(string &out, const string &val) {
+                    for (char c: val) {
+                        if (c == '\\') {
+                            out += "\\\\";
+                        } else if (c == '"') {
+                            out += "\\\"";
+                        } else if (c == '\n') {
+                            out += "\\n";
+                        } else {
+                            out.push_back(c);
+                        }
+                    }
+                }
+
+                static void appendNumber(string &out, double val) {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.9g", val);
+                    out += buf;
+                }
+
+                static void appendHeader(string &out, const char *name, const char *help, const char *type) {
+                    out += "# HELP ";
+                    out += name;
+                    out += ' ';
+                    out += help;
+                    out += "\n# TYPE ";
+                    out += name;
+                    out += ' ';
+                    out += type;
+                    out += '\n';
+                }
+
+                static void appendHistogram(string &out, const char *name, const string &labels,
+                                            const HistogramSnapshot &h) {
+                    UInt64 cumulative = 0;
+                    for (UInt32 i = 0; i <= HistogramSnapshot::BUCKETS; i++) {
+                        cumulative += h.buckets[i];
+                        out += name;
+                        out += "_bucket{";
+                        out += labels;
+                        out += labels.empty() ? "le=\"" : ",le=\"";
+                        if (i == HistogramSnapshot::BUCKETS) {
+                            out += "+Inf";
+                        } else {
+                            appendNumber(out, HistogramSnapshot::upperBound(i));
+                        }
+                        out += "\"} ";
+                        out += std::to_string(cumulative);
+                        out += '\n';
+                    }
+
+                    string braces = labels.empty() ? "" : "{" + labels + "}";
+                    out += name;
+                    out += "_sum";
+                    out += braces;
+                    out += ' ';
+                    appendNumber(out, (double) h.sumNanos / 1e9);
+                    out += '\n';
+                    out += name;
+                    out += "_count";
+                    out += braces;
+                    out += ' ';
+                    out += std::to_string(h.count);
+                    out += '\n';
+                }
+
+            public:
+                DBMetrics() = default;
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                DBMetrics(const DBMetrics &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                DBMetrics &operator=(const DBMetrics &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, statements and connections point to it
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                // Looked up once per statement; the returned reference is valid as long as the registry.
+                StatementMetrics &statement(const string &key) {
+                    std::lock_guard<std::mutex> lock{_mutex};
+                    std::unique_ptr<StatementMetrics> &ans = _statements[key];
+                    if (ans == nullptr) {
+                        ans = std::make_unique<StatementMetrics>();
+                    }
+                    return *ans;
+                }
+
+                LatencyHistogram &commit() {
+                    return _commit;
+                }
+
+                MetricsSnapshot snapshot() {
+                    MetricsSnapshot ans;
+                    ans.commit = _commit.snapshot();
+
+                    std::lock_guard<std::mutex> lock{_mutex};
+                    ans.statements.reserve(_statements.size());
+                    for (auto &entry: _statements) {
+                        const StatementMetrics &m = *entry.second;
+                        ans.statements.push_back({entry.first,
+                                                  m.prepare.snapshot(),
+                                                  m.execute.snapshot(),
+                                                  m.fetch.snapshot(),
+                                                  m.rows.load(std::memory_order_relaxed),
+                                                  m.bytes.load(std::memory_order_relaxed),
+                                                  m.binds.load(std::memory_order_relaxed)});
+                    }
+                    return ans;
+                }
+
+                // Prometheus text exposition format, with the SQL text or tag as the statement label.
+                string prometheus() {
+                    MetricsSnapshot snap = snapshot();
+
+                    std::vector<string> labels;
+                    labels.reserve(snap.statements.size());
+                    for (StatementMetricsSnapshot &s: snap.statements) {
+                        string label = "statement=\"";
+                        escapeLabel(label, s.key);
+                        label += '"';
+                        labels.push_back(std::move(label));
+                    }
+
+                    string out;
+                    struct Histogram {
+                        const char *name;
+                        const char *help;
+                        HistogramSnapshot StatementMetricsSnapshot::*field;
+                    };
+                    const Histogram histograms[] = {
+                            {"dpiw_prepare_seconds", "Time to prepare a statement, or take it from the cache.",
+                             &StatementMetricsSnapshot::prepare},
+                            {"dpiw_execute_seconds", "Time to execute a statement.",
+                             &StatementMetricsSnapshot::execute},
+                            {"dpiw_fetch_seconds", "Time spent fetching the rows of a query, per execution.",
+                             &StatementMetricsSnapshot::fetch},
+                    };
+
+                    for (const Histogram &h: histograms) {
+                        appendHeader(out, h.name, h.help, "histogram");
+                        for (size_t i = 0; i < snap.statements.size(); i++) {
+                            appendHistogram(out, h.name, labels[i], snap.statements[i].*h.field);
+                        }
+                    }
+
+                    struct Counter {
+                        const char *name;
+                        const char *help;
+                        UInt64 StatementMetricsSnapshot::*field;
+                    };
+                    const Counter counters[] = {
+                            {"dpiw_rows_fetched_total", "Rows fetched.", &StatementMetricsSnapshot::rows},
+                            {"dpiw_bytes_fetched_total", "Bytes of string and raw values fetched.",
+                             &StatementMetricsSnapshot::bytes},
+                            {"dpiw_binds_total", "Values and arrays bound.", &StatementMetricsSnapshot::binds},
+                    };
+
+                    for (const Counter &c: counters) {
+                        appendHeader(out, c.name, c.help, "counter");
+                        for (size_t i = 0; i < snap.statements.size(); i++) {
+                            out += c.name;
+                            out += '{';
+                            out += labels[i];
+                            out += "} ";
+                            out += std::to_string(snap.statements[i].*c.field);
+                            out += '\n';
+                        }
+                    }
+
+                    appendHeader(out, "dpiw_commit_seconds", "Time to commit a transaction.", "histogram");
+                    appendHistogram(out, "dpiw_commit_seconds", "", snap.commit);
+                    return out;
+                }
+            };
+        }
+    }
+}
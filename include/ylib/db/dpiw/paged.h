@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <ylib/db/dpiw.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            struct PageKey {
+                string column;
+                Bool descending{False};
+            };
+
+            /*
+             * Keyset ("seek") pagination: each page starts right after the last row of the previous one, through a
+             * predicate on the key columns, instead of skipping the rows before it with OFFSET. The cost of a page
+             * doesn't grow with its depth, as long as an index covers the keys in order.
+             *
+             * The keys must be in the select list of the query, be NOT NULL, and together identify a row (add the
+             * primary key last if they don't). Rows are ordered by them. Needs Oracle 12c or later for FETCH FIRST.
+             *
+             * The statements of the first page and of the rest are prepared once, and kept as long as the PagedQuery,
+             * which is therefore bound to its connection. The query's own binds must be by name, see bind().
+             */
+            class PagedQuery {
+            private:
+                struct KeyValue {
+                    dpiNativeTypeNum nativeTypeNum;
+                    dpiData data;
+                    string bytes; //BYTES only, the value data points to
+                };
+
+                std::vector<PageKey> _keys;
+                UInt32 _pageSize;
+                DBStatement _first;
+                DBStatement _next;
+                std::vector<UInt32> _positions; //of the keys in the select list, resolved on the first page
+                std::vector<KeyValue> _last; //of the last row read, empty before the first page
+                Bool _done{False};
+                UInt64 _pages = 0;
+
+                static string keyParam(size_t i) {
+                    return ":dpiw_k" + std::to_string(i + 1);
+                }
+
+                /*
+                 * For keys (a, b, c), the rows after the last one are:
+                 *
+                 *   a >= :a AND (a > :a OR (a = :a AND b > :b) OR (a = :a AND b = :b AND c > :c))
+                 *
+                 * The leading a >= :a is redundant, but lets the optimizer start an index range scan at the last key.
+                 */
+                static string seekPredicate(const std::vector<PageKey> &keys) {
+                    string ans = keys[0].column + (keys[0].descending == True ? " <= " : " >= ") + keyParam(0) + " AND (";
+                    for (size_t i = 0; i < keys.size(); i++) {
+                        ans += i == 0 ? "(" : " OR (";
+                        for (size_t j = 0; j < i; j++) {
+                            ans += keys[j].column + " = " + keyParam(j) + " AND ";
+                        }
+                        ans += keys[i].column + (keys[i].descending == True ? " < " : " > ") + keyParam(i) + ")";
+                    }
+                    return ans + ")";
+                }
+
+                static string pageSql(const string &sql, const std::vector<PageKey> &keys, UInt32 pageSize, Bool seek) {
+                    checkParamIsPositive("pageSize", pageSize);
+
+                    if (keys.empty()) {
+                        throw DBException("A PagedQuery needs at least one key column.");
+                    }
+
+                    // The line break keeps a trailing -- comment of sql from swallowing the closing parenthesis.
+                    string ans = "SELECT * FROM (\n" + sql + "\n)";
+                    if (seek == True) {
+                        ans += " WHERE " + seekPredicate(keys);
+                    }
+
+                    ans += " ORDER BY ";
+                    for (size_t i = 0; i < keys.size(); i++) {
+                        ans += i == 0 ? "" : ", ";
+                        ans += keys[i].column + (keys[i].descending == True ? " DESC" : "");
+                    }
+                    return ans + " FETCH FIRST " + std::to_string(pageSize) + " ROWS ONLY";
+                }
+
+                // Keeps the keys of the current row of rs, to bind them for the next page.
+                void keep(ResultSet &rs) {
+                    _last.resize(_keys.size());
+                    for (size_t i = 0; i < _keys.size(); i++) {
+                        KeyValue &key = _last[i];
+                        key.data = rs.getData(_positions[i], key.nativeTypeNum);
+                        if (key.data.isNull) {
+                            throw DBException(sfput("The key column {} is NULL. The keys of a PagedQuery must be "
+                                                    "NOT NULL.", _keys[i].column));
+                        }
+
+                        if (key.nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+                            key.bytes.assign(key.data.value.asBytes.ptr, key.data.value.asBytes.length);
+                        }
+                    }
+                }
+
+                void bindLast() {
+                    for (size_t i = 0; i < _last.size(); i++) {
+                        KeyValue &key = _last[i];
+                        if (key.nativeTypeNum == DPI_NATIVE_TYPE_BYTES) {
+                            key.data.value.asBytes.ptr = key.bytes.data();
+                            key.data.value.asBytes.length = (uint32_t) key.bytes.size();
+                        }
+                        _next.setData(keyParam(i).c_str(), key.nativeTypeNum, key.data);
+                    }
+                }
+
+            public:
+                // sql is the query without ORDER BY; it's wrapped as a subquery.
+                PagedQuery(DBConnection &conn, const string &sql, std::vector<PageKey> keys, UInt32 pageSize) :
+                        _keys{std::move(keys)},
+                        _pageSize{pageSize},
+                        _first{conn.statement(pageSql(sql, _keys, pageSize, False))},
+                        _next{conn.statement(pageSql(sql, _keys, pageSize, True))} {
+
+                    // One more row than the page, so the driver sees the end of the rows in the same round trip.
+                    UInt32 arraySize = std::min<UInt32>(pageSize + 1, 1000);
+                    _first.setFetchArraySize(arraySize);
+                    _next.setFetchArraySize(arraySize);
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                PagedQuery(const PagedQuery &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                PagedQuery &operator=(const PagedQuery &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, same as DBStatement
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                // Binds the query's own parameters: f is called with both statements. The values stay bound for every
+                // page.
+                void bind(const std::function<void(DBStatement &)> &f) {
+                    f(_first);
+                    f(_next);
+                }
+
+                // Runs the next page, calling f for each of its rows. Returns the rows of the page, 0 once they are all
+                // read.
+                UInt32 nextPage(const std::function<void(ResultSet &)> &f) {
+                    if (_done == True) {
+                        return 0;
+                    }
+
+                    DBStatement &stm = _last.empty() ? _first : _next;
+                    if (_last.empty() == false) {
+                        bindLast();
+                    }
+
+                    ResultSet rs = stm.execQuery();
+                    if (_positions.empty()) {
+                        for (const PageKey &key: _keys) {
+                            _positions.push_back(rs.columnIndex(key.column));
+                        }
+                    }
+
+                    UInt32 rows = 0;
+                    while (rs.next() == True) {
+                        rows++;
+                        f(rs);
+                        if (rows == _pageSize) {
+                            keep(rs);
+                        }
+                    }
+
+                    _pages++;
+                    _done = rows < _pageSize ? True : False;
+                    return rows;
+                }
+
+                // Whether the last page was read. The one after a full page may still be empty.
+                Bool done() {
+                    return _done;
+                }
+
+                UInt64 pages() {
+                    return _pages;
+                }
+
+                // Starts over from the first page, e.g. after rebinding the query's parameters.
+                void reset() {
+                    _last.clear();
+                    _done = False;
+                    _pages = 0;
+                }
+            };
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include <ylib/core/lang.h>
+
+using namespace ylib::core;
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            /*
+             * A blocking FIFO with a fixed capacity, used to hand work between the threads of a pipeline (e.g. the
+             * fetch and the write threads of an export). push blocks while the queue is full, pop while it's empty.
+             *
+             * Either side can close() the queue: pending pushes and any later push then return False, and pop returns
+             * the remaining items, then std::nullopt.
+             */
+            template<typename T>
+            class BoundedQueue {
+            private:
+                std::mutex _mutex;
+                std::condition_variable _notFull;
+                std::condition_variable _notEmpty;
+                std::deque<T> _items;
+                size_t _capacity;
+                Bool _closed{False};
+
+            public:
+                explicit BoundedQueue(size_t capacity) : _capacity{capacity} {
+                    checkParamIsPositive("capacity", capacity);
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                BoundedQueue(const BoundedQueue &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                BoundedQueue &operator=(const BoundedQueue &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, threads wait on its members
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                Bool push(T item) {
+                    std::unique_lock<std::mutex> lock{_mutex};
+                    _notFull.wait(lock, [this] { return _closed == True || _items.size() < _capacity; });
+
+                    if (_closed == True) {
+                        return False;
+                    }
+
+                    _items.push_back(std::move(item));
+                    lock.unlock();
+                    _notEmpty.notify_one();
+                    return True;
+                }
+
+                std::optional<T> pop() {
+                    std::unique_lock<std::mutex> lock{_mutex};
+                    _notEmpty.wait(lock, [this] { return _closed == True || _items.empty() == false; });
+
+                    if (_items.empty()) {
+                        return std::nullopt;
+                    }
+
+                    T item = std::move(_items.front());
+                    _items.pop_front();
+                    lock.unlock();
+                    _notFull.notify_one();
+                    return item;
+                }
+
+                void close() {
+                    {
+                        std::lock_guard<std::mutex> lock{_mutex};
+                        _closed = True;
+                    }
+                    _notFull.notify_all();
+                    _notEmpty.notify_all();
+                }
+
+                Bool closed() {
+                    std::lock_guard<std::mutex> lock{_mutex};
+                    return _closed;
+                }
+            };
+        }
+    }
+}
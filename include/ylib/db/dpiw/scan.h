@@ -0,0 +1,575 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <ylib/db/dpiw.h>
+#include <ylib/db/dpiw/export.h>
+#include <ylib/db/dpiw/queue.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            /*
+             * How a ParallelScan splits the table into chunks, the unit of work of its connections.
+             *
+             * RANGE reads the rows whose key is NULL, which no range matches, in one more chunk after the ranges: the
+             * last one in ordered mode. On a NOT NULL column that chunk is empty, and Oracle answers it without reading.
+             */
+            enum class ScanSplit {
+                ROWID, //ranges of extents, of heap tables owned by the user, smallfile or bigfile tablespaces
+                PARTITION, //one chunk per partition
+                RANGE //equal ranges of an integer column, between its MIN and MAX, then its NULLs
+            };
+
+            struct ParallelScanOptions {
+                ScanSplit split = ScanSplit::ROWID;
+                string rangeColumn; //RANGE only
+                UInt32 connections = 4; //acquired from the pool, one per thread
+                UInt32 chunks = 0; //ROWID and RANGE, 0 is 4 per connection
+                UInt32 batchRows = 1000; //rows per fetch round trip, and per ScanBatch
+                UInt32 queueDepth = 16; //batches in flight between the connections and the consumers
+                Bool ordered{False}; //hand the batches over in chunk order, see ParallelScan
+                Int64 scn = 0; //the snapshot to read, 0 is the current SCN
+            };
+
+            /*
+             * The rows of one fetch round trip, copied off the driver's buffers so it can cross threads (see ExportBlock).
+             * rows() reads them with the usual RowBatch getters.
+             */
+            struct ScanBatch {
+                UInt32 chunk = 0; //0-based, in the order of the split
+                ExportBlock block;
+                std::vector<dpiNativeTypeNum> types;
+                std::vector<dpiData *> columns;
+
+                void fill(UInt32 chunkIndex, const RowBatch &batch, const std::vector<dpiNativeTypeNum> &nativeTypes) {
+                    chunk = chunkIndex;
+                    types = nativeTypes;
+                    block.fill(batch, types);
+
+                    // The arena doesn't grow anymore, the BYTES cells can point into it.
+                    columns.resize(block.columnCount);
+                    for (UInt32 col = 0; col < block.columnCount; col++) {
+                        columns[col] = &block.cells[(size_t) col * block.rowCount];
+                        if (types[col] != DPI_NATIVE_TYPE_BYTES) {
+                            continue;
+                        }
+
+                        const size_t *offsets = &block.offsets[(size_t) col * block.rowCount];
+                        for (UInt32 row = 0; row < block.rowCount; row++) {
+                            dpiData &cell = columns[col][row];
+                            if (cell.isNull == 0) {
+                                cell.value.asBytes.ptr = block.arena.data() + offsets[row];
+                            }
+                        }
+                    }
+                }
+
+                UInt32 rowCount() const {
+                    return block.rowCount;
+                }
+
+                // Valid as long as the ScanBatch.
+                RowBatch rows() {
+                    return RowBatch{columns.data(), types.data(), block.columnCount, 0, block.rowCount, False};
+                }
+            };
+
+            /*
+             * Reads a table over several pooled connections at once, each one scanning its own chunks of it (by ROWID
+             * range, partition, or range of an integer key), all at the same SCN through flashback queries, so together
+             * they see a single consistent snapshot. The connections pull chunks as they finish the previous ones.
+             *
+             * The rows come out as ScanBatch, through next(). Unordered, next() can be called from any number of
+             * consumer threads, and each batch goes to one of them. Ordered, the batches come in chunk order, the
+             * connections working ahead by at most queueDepth batches: the order of the split, and, for RANGE, sorted
+             * by the key, since each chunk is then ordered by it.
+             *
+             * The SCN must still be in the undo retention when the last chunk starts, or the scan fails with ORA-01555.
+             * The current SCN is read with DBMS_FLASHBACK.GET_SYSTEM_CHANGE_NUMBER, which needs EXECUTE on it; when
+             * missing, pass options.scn. Link with **pthread**.
+             */
+            class ParallelScan {
+            private:
+                using Queue = BoundedQueue<std::unique_ptr<ScanBatch>>;
+
+                struct Chunk {
+                    string partition; //PARTITION
+                    string low; //ROWID
+                    string high;
+                    Int64 lowKey = 0; //RANGE, inclusive
+                    Int64 highKey = 0;
+                    Bool nullKeys{False}; //RANGE, the rows whose key is NULL instead of a range
+                };
+
+                DBPool &_pool;
+                string _owner; //as in the dictionary, empty when not qualified
+                string _name; //as in the dictionary
+                string _table; //quoted, as used in the queries
+                string _columns;
+                string _filter;
+                ParallelScanOptions _options;
+                std::function<void(DBStatement &)> _bind;
+
+                Int64 _scn = 0;
+                std::vector<Chunk> _chunks;
+                std::atomic<UInt32> _nextChunk{0};
+
+                std::unique_ptr<Queue> _out; //unordered
+                std::vector<std::unique_ptr<Queue>> _chunkQueues; //ordered, one per chunk
+                UInt32 _current = 0; //ordered, the chunk being handed over
+                std::mutex _orderMutex;
+
+                std::once_flag _started;
+                std::vector<std::thread> _workers;
+                std::atomic<UInt32> _running{0};
+                std::atomic<bool> _failed{false};
+                std::atomic<bool> _stopped{false};
+                std::mutex _errorMutex;
+                std::exception_ptr _error;
+
+                // Extended ROWID, OOOOOOFFFBBBBBBRRR: data object, relative file, block and row in base 64. A bigfile
+                // tablespace has a single file, and its block numbers take the file's digits too: OOOOOOBBBBBBBBBRRR.
+                static string rowid(Bool bigfile, UInt64 object, UInt64 file, UInt64 block, UInt64 row) {
+                    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+                    string ans(18, 'A');
+                    auto put = [&ans](size_t pos, size_t count, UInt64 val) {
+                        for (size_t i = pos + count; i > pos; i--) {
+                            ans[i - 1] = digits[val & 63];
+                            val >>= 6;
+                        }
+                    };
+                    put(0, 6, object);
+                    if (bigfile == True) {
+                        put(6, 9, block);
+                    } else {
+                        put(6, 3, file);
+                        put(9, 6, block);
+                    }
+                    put(15, 3, row);
+                    return ans;
+                }
+
+                // Splits table into its owner, if qualified, and its name, as the dictionary has them: the unquoted
+                // parts upper-cased, the quoted ones as they are.
+                static std::pair<string, string> parseTableName(const string &table) {
+                    std::vector<string> parts{""};
+                    Bool quoted{False};
+                    Bool wasQuoted{False};
+                    for (char c: table) {
+                        if (c == '"') {
+                            quoted = quoted == True ? False : True;
+                            wasQuoted = True;
+                        } else if (quoted == True) {
+                            parts.back() += c;
+                        } else if (c == '.') {
+                            parts.emplace_back();
+                            wasQuoted = False;
+                        } else if (isspace((unsigned char) c) == 0) {
+                            parts.back() += wasQuoted == True ? c : (char) toupper((unsigned char) c);
+                        }
+                    }
+
+                    if (quoted == True || parts.size() > 2 ||
+                        std::any_of(parts.begin(), parts.end(), [](const string &part) { return part.empty(); })) {
+                        throw DBException(sfput("Invalid table name: {}.", table));
+                    }
+                    return parts.size() == 2 ? std::make_pair(parts[0], parts[1]) : std::make_pair(string{}, parts[0]);
+                }
+
+                UInt32 targetChunks() const {
+                    return _options.chunks > 0 ? _options.chunks : _options.connections * 4;
+                }
+
+                // The query of chunk, or of the whole table when chunk is null.
+                string query(const string &selectList, const Chunk *chunk) const {
+                    string sql = "SELECT " + selectList + " FROM " + _table;
+                    if (chunk && _options.split == ScanSplit::PARTITION) {
+                        sql += " PARTITION (\"" + chunk->partition + "\")";
+                    }
+                    sql += " AS OF SCN :dpiw_scn";
+
+                    std::vector<string> conditions;
+                    if (_filter.empty() == false) {
+                        conditions.push_back("(" + _filter + ")");
+                    }
+                    if (chunk && _options.split == ScanSplit::ROWID) {
+                        conditions.emplace_back("ROWID BETWEEN CHARTOROWID(:dpiw_lo) AND CHARTOROWID(:dpiw_hi)");
+                    }
+                    if (chunk && _options.split == ScanSplit::RANGE) {
+                        conditions.push_back(_options.rangeColumn +
+                                             (chunk->nullKeys == True ? " IS NULL" : " BETWEEN :dpiw_lo AND :dpiw_hi"));
+                    }
+
+                    for (size_t i = 0; i < conditions.size(); i++) {
+                        sql += i == 0 ? " WHERE " : " AND ";
+                        sql += conditions[i];
+                    }
+
+                    if (chunk && _options.split == ScanSplit::RANGE && chunk->nullKeys == False &&
+                        _options.ordered == True) {
+                        sql += " ORDER BY " + _options.rangeColumn;
+                    }
+                    return sql;
+                }
+
+                void planRowid(DBConnection &conn) {
+                    // The extents are only visible to their owner, which a qualified name may not be.
+                    if (_owner.empty() == false) {
+                        DBStatement user = conn.statement("SELECT USER FROM dual");
+                        ResultSet rs = user.execQuery();
+                        rs.next();
+                        if (rs.getString(1) != _owner) {
+                            throw DBException(sfput("A ROWID split needs a table owned by the user, {} is not.",
+                                                    _table));
+                        }
+                    }
+
+                    // user_tablespaces may not list a tablespace the user has no quota on. A bigfile one is also told
+                    // by its relative file number, always 1024, past the last of a smallfile one.
+                    DBStatement stmt = conn.statement(
+                            "SELECT o.data_object_id, e.relative_fno, e.block_id, e.blocks, "
+                            "NVL(t.bigfile, CASE WHEN e.relative_fno = 1024 THEN 'YES' ELSE 'NO' END) "
+                            "FROM user_extents e "
+                            "JOIN user_objects o ON o.object_name = e.segment_name "
+                            "AND NVL(o.subobject_name, ' ') = NVL(e.partition_name, ' ') "
+                            "LEFT JOIN user_tablespaces t ON t.tablespace_name = e.tablespace_name "
+                            "WHERE e.segment_name = :dpiw_table "
+                            "AND e.segment_type LIKE 'TABLE%' AND o.object_type LIKE 'TABLE%' "
+                            "ORDER BY o.data_object_id, e.relative_fno, e.block_id");
+                    stmt.setString(":dpiw_table", _name);
+                    stmt.setFetchArraySize(1000);
+
+                    struct Extent {
+                        Int64 object, file, block, blocks;
+                        Bool bigfile;
+                    };
+                    std::vector<Extent> extents;
+                    UInt64 totalBlocks = 0;
+                    stmt.execQuery().forEach([&](ResultSet &rs) {
+                        extents.push_back({rs.getInt64(1), rs.getInt64(2), rs.getInt64(3), rs.getInt64(4),
+                                           rs.getString(5) == "YES" ? True : False});
+                        totalBlocks += extents.back().blocks;
+                    });
+
+                    // Consecutive extents, in ROWID order, until a chunk has its share of the blocks. A range spanning
+                    // several extents only ever matches rows of the table's own extents in between.
+                    UInt64 share = totalBlocks / targetChunks() + 1;
+                    UInt64 blocks = 0;
+                    for (size_t i = 0; i < extents.size(); i++) {
+                        const Extent &e = extents[i];
+                        if (blocks == 0) {
+                            _chunks.emplace_back();
+                            _chunks.back().low = rowid(e.bigfile, e.object, e.file, e.block, 0);
+                        }
+
+                        blocks += e.blocks;
+                        if (blocks >= share || i + 1 == extents.size()) {
+                            _chunks.back().high = rowid(e.bigfile, e.object, e.file, e.block + e.blocks - 1, 32767);
+                            blocks = 0;
+                        }
+                    }
+                }
+
+                void planPartitions(DBConnection &conn) {
+                    DBStatement stmt = conn.statement("SELECT partition_name FROM all_tab_partitions "
+                                                      "WHERE table_owner = NVL(:dpiw_owner, USER) "
+                                                      "AND table_name = :dpiw_table "
+                                                      "ORDER BY partition_position");
+                    stmt.setString(":dpiw_owner", _owner);
+                    stmt.setString(":dpiw_table", _name);
+                    stmt.execQuery().forEach([&](ResultSet &rs) {
+                        _chunks.emplace_back();
+                        _chunks.back().partition = rs.getString(1);
+                    });
+
+                    if (_chunks.empty()) {
+                        throw DBException(sfput("The table {} has no partitions.", _table));
+                    }
+                }
+
+                void planRange(DBConnection &conn) {
+                    const string &col = _options.rangeColumn;
+                    DBStatement stmt = conn.statement(query("MIN(" + col + "), MAX(" + col + ")", nullptr));
+                    stmt.setInt64(":dpiw_scn", _scn);
+                    if (_bind) {
+                        _bind(stmt);
+                    }
+
+                    ResultSet rs = stmt.execQuery();
+                    rs.next();
+
+                    // No MIN when there are no rows, or only NULL keys.
+                    dpiNativeTypeNum type;
+                    if (rs.getData(1, type).isNull == 0) {
+                        Int64 min = rs.getInt64(1);
+                        Int64 max = rs.getInt64(2);
+                        UInt64 width = ((UInt64) max - (UInt64) min) / targetChunks() + 1;
+                        for (Int64 low = min;;) {
+                            _chunks.emplace_back();
+                            _chunks.back().lowKey = low;
+                            if ((UInt64) max - (UInt64) low < width) {
+                                _chunks.back().highKey = max;
+                                break;
+                            }
+                            _chunks.back().highKey = (Int64) ((UInt64) low + width - 1);
+                            low = (Int64) ((UInt64) low + width);
+                        }
+                    }
+
+                    _chunks.emplace_back();
+                    _chunks.back().nullKeys = True;
+                }
+
+                void start() {
+                    {
+                        DBConnection conn = _pool.acquire();
+                        _scn = _options.scn;
+                        if (_scn == 0) {
+                            DBStatement stmt = conn.statement(
+                                    "SELECT DBMS_FLASHBACK.GET_SYSTEM_CHANGE_NUMBER FROM dual");
+                            ResultSet rs = stmt.execQuery();
+                            rs.next();
+                            _scn = rs.getInt64(1);
+                        }
+
+                        switch (_options.split) {
+                            case ScanSplit::ROWID:
+                                planRowid(conn);
+                                break;
+                            case ScanSplit::PARTITION:
+                                planPartitions(conn);
+                                break;
+                            case ScanSplit::RANGE:
+                                planRange(conn);
+                                break;
+                        }
+                    }
+
+                    if (_options.ordered == True) {
+                        size_t capacity = std::max<size_t>(_options.queueDepth / _options.connections, 1);
+                        for (size_t i = 0; i < _chunks.size(); i++) {
+                            _chunkQueues.push_back(std::make_unique<Queue>(capacity));
+                        }
+                    } else {
+                        _out = std::make_unique<Queue>(_options.queueDepth);
+                    }
+
+                    UInt32 threads = std::min<UInt32>(_options.connections, (UInt32) _chunks.size());
+                    if (threads == 0) {
+                        closeAll();
+                        return;
+                    }
+
+                    _running = threads;
+                    for (UInt32 i = 0; i < threads; i++) {
+                        _workers.emplace_back([this]() {
+                            work();
+                        });
+                    }
+                }
+
+                void closeAll() {
+                    if (_out) {
+                        _out->close();
+                    }
+                    for (std::unique_ptr<Queue> &queue: _chunkQueues) {
+                        queue->close();
+                    }
+                }
+
+                void fail(std::exception_ptr err) {
+                    {
+                        std::lock_guard<std::mutex> lock{_errorMutex};
+                        if (_error == nullptr) {
+                            _error = err;
+                        }
+                    }
+                    _failed = true;
+                    closeAll();
+                }
+
+                // Returns False when the consumers are gone.
+                Bool scanChunk(DBConnection &conn, UInt32 index) {
+                    const Chunk &chunk = _chunks[index];
+                    Queue &out = _options.ordered == True ? *_chunkQueues[index] : *_out;
+
+                    DBStatement stmt = conn.statement(query(_columns, &chunk));
+                    stmt.setFetchArraySize(_options.batchRows);
+                    stmt.setInt64(":dpiw_scn", _scn);
+                    if (_options.split == ScanSplit::ROWID) {
+                        stmt.setString(":dpiw_lo", chunk.low);
+                        stmt.setString(":dpiw_hi", chunk.high);
+                    } else if (_options.split == ScanSplit::RANGE && chunk.nullKeys == False) {
+                        stmt.setInt64(":dpiw_lo", chunk.lowKey);
+                        stmt.setInt64(":dpiw_hi", chunk.highKey);
+                    }
+                    if (_bind) {
+                        _bind(stmt);
+                    }
+
+                    ResultSet rs = stmt.execQuery();
+                    rs.inlineLobs();
+
+                    std::vector<dpiNativeTypeNum> types;
+                    for (RowBatch batch = rs.nextBatch(_options.batchRows); batch.empty() == False;
+                         batch = rs.nextBatch(_options.batchRows)) {
+                        if (types.empty()) {
+                            for (UInt32 col = 1; col <= batch.columnCount(); col++) {
+                                types.push_back(batch.nativeTypeNum(col));
+                            }
+                        }
+
+                        auto scanBatch = std::make_unique<ScanBatch>();
+                        scanBatch->fill(index, batch, types);
+                        if (out.push(std::move(scanBatch)) == False) {
+                            return False;
+                        }
+                    }
+
+                    if (_options.ordered == True) {
+                        out.close();
+                    }
+                    return True;
+                }
+
+                void work() {
+                    try {
+                        DBConnection conn = _pool.acquire();
+                        while (_failed.load() == false && _stopped.load() == false) {
+                            UInt32 index = _nextChunk.fetch_add(1);
+                            if (index >= _chunks.size() || scanChunk(conn, index) == False) {
+                                break;
+                            }
+                        }
+                    } catch (...) {
+                        fail(std::current_exception());
+                    }
+
+                    if (_running.fetch_sub(1) == 1 && _out) {
+                        _out->close();
+                    }
+                }
+
+            public:
+                // table is [owner.]name, each part quoted or not as in SQL. columns is the select list, and filter an
+                // optional WHERE condition over the table.
+                ParallelScan(DBPool &pool, const string &table, string columns, string filter = "",
+                             ParallelScanOptions options = {}) : _pool{pool},
+                                                                 _columns{std::move(columns)},
+                                                                 _filter{std::move(filter)},
+                                                                 _options{std::move(options)} {
+                    std::tie(_owner, _name) = parseTableName(table);
+                    _table = _owner.empty() ? "\"" + _name + "\"" : "\"" + _owner + "\".\"" + _name + "\"";
+
+                    checkParamIsPositive("connections", _options.connections);
+                    checkParamIsPositive("batchRows", _options.batchRows);
+                    checkParamIsPositive("queueDepth", _options.queueDepth);
+
+                    if (_options.split == ScanSplit::RANGE && _options.rangeColumn.empty()) {
+                        throw DBException("A RANGE split needs the rangeColumn.");
+                    }
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                ParallelScan(const ParallelScan &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                ParallelScan &operator=(const ParallelScan &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, the workers point to it
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Stops the connections, even halfway through, and waits for them.
+                virtual ~ParallelScan() {
+                    try {
+                        _stopped = true;
+                        closeAll();
+                        for (std::thread &worker: _workers) {
+                            worker.join();
+                        }
+                    } catch (std::exception &ex) {
+                        log.error(ex);
+                    }
+                }
+                // =========================================================================
+
+                // Binds the filter's parameters, which must be by name: f is called with every statement of the scan,
+                // before it's executed, from the connection's thread.
+                void bind(std::function<void(DBStatement &)> f) {
+                    _bind = std::move(f);
+                }
+
+                // The next batch, or nullptr after the last one. The first call reads the SCN, splits the table and
+                // starts the connections. Rethrows the first error of any connection.
+                std::unique_ptr<ScanBatch> next() {
+                    std::call_once(_started, [this]() {
+                        start();
+                    });
+
+                    std::optional<std::unique_ptr<ScanBatch>> batch;
+                    if (_options.ordered == True) {
+                        std::lock_guard<std::mutex> lock{_orderMutex};
+                        while (_current < _chunkQueues.size()) {
+                            batch = _chunkQueues[_current]->pop();
+                            if (batch.has_value() || _failed.load()) {
+                                break;
+                            }
+                            _current++;
+                        }
+                    } else {
+                        batch = _out->pop();
+                    }
+
+                    if (_failed.load()) {
+                        std::lock_guard<std::mutex> lock{_errorMutex};
+                        std::rethrow_exception(_error);
+                    }
+                    return batch.has_value() ? std::move(*batch) : nullptr;
+                }
+
+                // Hands every batch to f, on the calling thread. Returns the number of rows.
+                UInt64 forEachBatch(const std::function<void(ScanBatch &)> &f) {
+                    UInt64 rows = 0;
+                    while (std::unique_ptr<ScanBatch> batch = next()) {
+                        rows += batch->rowCount();
+                        f(*batch);
+                    }
+                    return rows;
+                }
+
+                // The SCN the table is read at, once started.
+                Int64 scn() const {
+                    return _scn;
+                }
+
+                // The number of chunks, once started.
+                UInt32 chunkCount() const {
+                    return (UInt32) _chunks.size();
+                }
+            };
+        }
+    }
+}
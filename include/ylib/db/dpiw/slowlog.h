@@ -0,0 +1,246 @@
+#pragma once
+
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include <dpi.h>
+#include <ylib/core/lang.h>
+#include <ylib/logging/Logger.h>
+
+using namespace ylib::core;
+using ylib::logging::Logger;
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            struct SlowQueryOptions {
+                // Executions at or above it are logged: execute time, plus the fetch time for queries.
+                UInt64 thresholdMicros = 1000000;
+
+                // Fraction of the executions that are watched, from 0 to 1. The rest aren't timed and their binds
+                // aren't captured, so on hot paths keep it low.
+                double sampleRate = 1.0;
+
+                Bool binds = True;
+
+                // Called with the name of each bind, ":<name>" or ":<position>". Those for which it returns True are
+                // logged as ***. When not set, every value is logged.
+                std::function<Bool(const string &bind)> redact;
+
+                // Longer string values are cut, and end with "...".
+                UInt32 maxValueLength = 64;
+            };
+
+            class SlowQueryLog;
+
+            // One watched execution of a statement: what's logged if it turns out to be slow.
+            struct SlowQueryTrace {
+                SlowQueryLog *log = nullptr; //not owned
+                string sql;
+                string tag;
+                std::vector<std::pair<string, string>> binds; //name, value already formatted
+                UInt64 executeNanos = 0;
+                UInt64 fetchNanos = 0;
+                UInt64 rows = 0;
+            };
+
+            /*
+             * Logs the statements that take longer than a threshold, with their SQL text, binds, execute and fetch time,
+             * and rows. Attach it with DBConnection::setSlowQueryLog or DBPool::setSlowQueryLog. Shared by any number of
+             * connections and threads.
+             *
+             * Sampling is by count, one every 1 / sampleRate executions, rather than random, so it costs a relaxed
+             * atomic increment.
+             */
+            class SlowQueryLog {
+            private:
+                SlowQueryOptions _options;
+                UInt64 _thresholdNanos;
+                UInt64 _period; //0 when nothing is sampled
+                std::atomic<UInt64> _executions{0};
+                std::atomic<UInt64> _logged{0};
+                Logger _logger = Logger::get("ylib::db::odpi::slow");
+
+                void appendValue(string &out, dpiNativeTypeNum nativeTypeNum, const dpiData &data) const {
+                    if (data.isNull) {
+                        out += "NULL";
+                        return;
+                    }
+
+                    char buf[64];
+                    switch (nativeTypeNum) {
+                        case DPI_NATIVE_TYPE_INT64:
+                            snprintf(buf, sizeof(buf), "%" PRId64, data.value.asInt64);
+                            break;
+                        case DPI_NATIVE_TYPE_UINT64:
+                            snprintf(buf, sizeof(buf), "%" PRIu64, data.value.asUint64);
+                            break;
+                        case DPI_NATIVE_TYPE_DOUBLE:
+                            snprintf(buf, sizeof(buf), "%.17g", data.value.asDouble);
+                            break;
+                        case DPI_NATIVE_TYPE_FLOAT:
+                            snprintf(buf, sizeof(buf), "%.9g", (double) data.value.asFloat);
+                            break;
+                        case DPI_NATIVE_TYPE_BOOLEAN:
+                            snprintf(buf, sizeof(buf), "%s", data.value.asBoolean ? "TRUE" : "FALSE");
+                            break;
+                        case DPI_NATIVE_TYPE_TIMESTAMP: {
+                            const dpiTimestamp &ts = data.value.asTimestamp;
+                            snprintf(buf, sizeof(buf), "%04d-%02u-%02u %02u:%02u:%02u.%06u", ts.year, ts.month, ts.day,
+                                     ts.hour, ts.minute, ts.second, ts.fsecond / 1000);
+                            break;
+                        }
+                        case DPI_NATIVE_TYPE_BYTES: {
+                            std::string_view val{data.value.asBytes.ptr, data.value.asBytes.length};
+                            out += '\'';
+                            out += val.substr(0, _options.maxValueLength);
+                            out += val.size() > _options.maxValueLength ? "...'" : "'";
+                            return;
+                        }
+                        case DPI_NATIVE_TYPE_LOB:
+                            snprintf(buf, sizeof(buf), "<lob>");
+                            break;
+                        default:
+                            snprintf(buf, sizeof(buf), "<native type %d>", (int) nativeTypeNum);
+                            break;
+                    }
+                    out += buf;
+                }
+
+                static void appendMillis(string &out, UInt64 nanos) {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.3f ms", (double) nanos / 1e6);
+                    out += buf;
+                }
+
+            public:
+                explicit SlowQueryLog(const SlowQueryOptions &options = {}) : _options{options} {
+                    if (std::isnan(_options.sampleRate) || _options.sampleRate < 0 || _options.sampleRate > 1) {
+                        throw Exception(sfput("The sampleRate must be between 0 and 1, found: {}.",
+                                              _options.sampleRate));
+                    }
+
+                    _thresholdNanos = _options.thresholdMicros * 1000;
+                    _period = _options.sampleRate == 0 ? 0 : (UInt64) std::llround(1 / _options.sampleRate);
+                }
+
+                // Rule of five
+                // =========================================================================
+                // 1. Copy Constructor
+                // No copy constructor allowed
+                SlowQueryLog(const SlowQueryLog &) = delete;
+
+                // 2. Copy Assignment
+                // No copy assignment allowed
+                SlowQueryLog &operator=(const SlowQueryLog &other) = delete;
+
+                // 3. Move Constructor
+                // Not allowed, statements and connections point to it
+
+                // 4. Move Assignment
+                // Not allowed
+
+                // 5. Destructor
+                // Default
+                // =========================================================================
+
+                // Whether the next execution is watched.
+                Bool sample() {
+                    if (_period == 0) {
+                        return False;
+                    }
+                    return _executions.fetch_add(1, std::memory_order_relaxed) % _period == 0 ? True : False;
+                }
+
+                // Keeps the value of a bind in trace, replacing the one bound before under the same name.
+                void bind(SlowQueryTrace &trace, string name, dpiNativeTypeNum nativeTypeNum, const dpiData &data) {
+                    if (_options.binds == False) {
+                        return;
+                    }
+
+                    string value;
+                    if (_options.redact && _options.redact(name) == True) {
+                        value = "***";
+                    } else {
+                        appendValue(value, nativeTypeNum, data);
+                    }
+                    bind(trace, std::move(name), std::move(value));
+                }
+
+                void bind(SlowQueryTrace &trace, string name, string value) {
+                    if (_options.binds == False) {
+                        return;
+                    }
+
+                    for (std::pair<string, string> &entry: trace.binds) {
+                        if (entry.first == name) {
+                            entry.second = std::move(value);
+                            return;
+                        }
+                    }
+                    trace.binds.emplace_back(std::move(name), std::move(value));
+                }
+
+                // Logs trace when it's over the threshold. The binds are kept, since they stay bound for the next
+                // execution.
+                void finish(SlowQueryTrace &trace) {
+                    UInt64 elapsed = trace.executeNanos + trace.fetchNanos;
+                    if (elapsed >= _thresholdNanos) {
+                        _logged.fetch_add(1, std::memory_order_relaxed);
+                        _logger.warn(format(trace));
+                    }
+
+                    trace.executeNanos = 0;
+                    trace.fetchNanos = 0;
+                    trace.rows = 0;
+                }
+
+                string format(const SlowQueryTrace &trace) const {
+                    string out = "Slow statement: ";
+                    appendMillis(out, trace.executeNanos + trace.fetchNanos);
+                    out += " (execute ";
+                    appendMillis(out, trace.executeNanos);
+                    out += ", fetch ";
+                    appendMillis(out, trace.fetchNanos);
+                    out += "), ";
+                    out += std::to_string(trace.rows);
+                    out += " rows";
+                    if (trace.tag.empty() == false) {
+                        out += ", tag ";
+                        out += trace.tag;
+                    }
+                    out += ": ";
+                    out += trace.sql;
+
+                    if (trace.binds.empty() == false) {
+                        out += " [";
+                        for (size_t i = 0; i < trace.binds.size(); i++) {
+                            out += i == 0 ? "" : ", ";
+                            out += trace.binds[i].first;
+                            out += '=';
+                            out += trace.binds[i].second;
+                        }
+                        out += ']';
+                    }
+                    return out;
+                }
+
+                // Statements logged so far.
+                UInt64 loggedCount() const {
+                    return _logged.load(std::memory_order_relaxed);
+                }
+
+                const SlowQueryOptions &options() const {
+                    return _options;
+                }
+            };
+        }
+    }
+}
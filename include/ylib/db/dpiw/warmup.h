@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ylib/db/dpiw.h>
+#include <ylib/db/dpiw/metrics.h>
+
+
+namespace ylib {
+    namespace db {
+        namespace dpiw {
+
+            struct WarmUpOptions {
+                UInt32 connections = 1; //sessions to open, at most the pool's maxSessions
+                std::vector<string> statements; //SQL parsed on each session
+            };
+
+            struct WarmUpResult {
+                UInt32 connections = 0;
+                UInt32 statements = 0; //parsed, over all the sessions
+                UInt64 connectMillis = 0;
+                UInt64 slowestConnectMillis = 0; //of a single session
+                UInt64 parseMillis = 0;
+                UInt64 totalMillis = 0;
+            };
+
+            namespace warmup {
+
+                // Lets the threads wait for each other at the end of a phase.
+                class Phase {
+                private:
+                    std::mutex _mutex;
+                    std::condition_variable _done;
+                    UInt32 _pending;
+
+                public:
+                    explicit Phase(UInt32 threads) : _pending{threads} {
+
+                    }
+
+                    void arrive() {
+                        std::lock_guard<std::mutex> lock{_mutex};
+                        if (--_pending == 0) {
+                            _done.notify_all();
+                        }
+                    }
+
+                    void wait() {
+                        std::unique_lock<std::mutex> lock{_mutex};
+                        _done.wait(lock, [this]() { return _pending == 0; });
+                    }
+                };
+
+                inline UInt64 millisSince(UInt64 startNanos) {
+                    return (monotonicNanos() - startNanos) / 1000000;
+                }
+            }
+
+            /*
+             * Opens options.connections sessions of pool at once, one thread each, instead of one logon after the
+             * other, then parses every statement of options.statements on each of them. The sessions go back to the
+             * pool with the parsed cursors in their statement cache, so the first executions skip the logon and the
+             * parse. Meant to run at startup, before the service reports ready.
+             *
+             * All the sessions are held until every one has finished, so each thread warms up a different one, and
+             * options.connections can not be over the pool's maxSessions. The time of each phase is logged, and
+             * returned. The statement caches must be big enough for the statements,
+             * see DBConnection::setStatementCacheSize.
+             */
+            inline WarmUpResult warmUp(DBPool &pool, const WarmUpOptions &options) {
+                checkParamIsPositive("connections", options.connections);
+
+                // Each thread holds its session until they all have one, so any thread over maxSessions would wait
+                // for a session that is never released.
+                if (options.connections > pool.maxSessions()) {
+                    throw DBException(sfput("Can not warm up {} connections, the pool's maxSessions is {}.",
+                                            options.connections, pool.maxSessions()));
+                }
+
+                const UInt32 threads = options.connections;
+                warmup::Phase connected{threads};
+                warmup::Phase parsed{threads};
+                std::vector<UInt64> connectMillis(threads, 0);
+                std::vector<std::exception_ptr> errors(threads);
+                std::atomic<bool> failed{false};
+
+                WarmUpResult ans;
+                UInt64 start = monotonicNanos();
+
+                std::vector<std::thread> workers;
+                for (UInt32 i = 0; i < threads; i++) {
+                    workers.emplace_back([&, i]() {
+                        Bool connectDone{False};
+                        Bool parseDone{False};
+                        try {
+                            UInt64 acquireStart = monotonicNanos();
+                            DBConnection conn = pool.acquire();
+                            connectMillis[i] = warmup::millisSince(acquireStart);
+                            connectDone = True;
+                            connected.arrive();
+                            connected.wait();
+
+                            if (failed == false) {
+                                for (const string &sql: options.statements) {
+                                    conn.statement(sql).parse();
+                                }
+                            }
+                            parseDone = True;
+                            parsed.arrive();
+                            parsed.wait();
+                        } catch (...) {
+                            errors[i] = std::current_exception();
+                            failed = true;
+                            if (connectDone == False) {
+                                connected.arrive();
+                            }
+                            if (parseDone == False) {
+                                parsed.arrive();
+                            }
+                        }
+                    });
+                }
+
+                // The phases are timed from here, as each one ends when its slowest thread does.
+                connected.wait();
+                ans.connectMillis = warmup::millisSince(start);
+                UInt64 parseStart = monotonicNanos();
+                parsed.wait();
+                ans.parseMillis = warmup::millisSince(parseStart);
+
+                for (std::thread &worker: workers) {
+                    worker.join();
+                }
+
+                for (std::exception_ptr &err: errors) {
+                    if (err) {
+                        log.error(sfput("Pool warm-up failed after {} ms.", warmup::millisSince(start)));
+                        std::rethrow_exception(err);
+                    }
+                }
+
+                ans.connections = threads;
+                ans.statements = (UInt32) options.statements.size() * threads;
+                ans.slowestConnectMillis = *std::max_element(connectMillis.begin(), connectMillis.end());
+                ans.totalMillis = warmup::millisSince(start);
+
+                log.info(sfput("Pool warm-up: {} sessions opened in {} ms.", ans.connections, ans.connectMillis));
+                log.info(sfput("Pool warm-up: {} statements parsed on each session in {} ms.",
+                               options.statements.size(), ans.parseMillis));
+                log.info(sfput("Pool warm-up: done in {} ms, {} sessions open.", ans.totalMillis, pool.openCount()));
+                return ans;
+            }
+        }
+    }
+}